@@ -0,0 +1,457 @@
+/**
+ * @file benchmark.cc
+ * @brief runs every data/query/candidate set triple of the repository and
+ * writes one JSON record per triple and result cap.
+ *
+ */
+
+#include "backtrack.h"
+#include "candidate_set.h"
+#include "common.h"
+#include "graph.h"
+#include "intersection.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct BenchmarkOptions {
+  std::string root = ".";
+  std::string output = "benchmark.jsonl";
+  std::string baseline;
+  std::string filter;
+  size_t warmup = 1;
+  size_t repetitions = 3;
+  std::vector<size_t> caps = {1000, 100000};
+  double timeout = 10;
+  double tolerance = 0.1;
+  VertexOrdering ordering = VertexOrdering::kNone;
+  bool refine = false;
+  SearchOptions search;
+};
+
+struct Triple {
+  std::string name;
+  std::string data;
+  std::string query;
+  std::string candidate_set;
+};
+
+void PrintUsage() {
+  std::cerr << "Usage: ./bench [options]\n"
+               "Options:\n"
+               "  --root <dir>            directory holding data/, query/ and "
+               "candidate_set/\n"
+               "  --filter <text,...>     only queries whose name contains "
+               "one of the\n"
+               "                          texts\n"
+               "  --warmup <n>            untimed runs before measuring "
+               "(default: 1)\n"
+               "  --repetitions <n>       timed runs, the median is reported "
+               "(default: 3)\n"
+               "  --caps <k,...>          result caps (default: 1000,100000)\n"
+               "  --timeout <seconds>     time budget of one query, all caps "
+               "included\n"
+               "                          (default: 10)\n"
+               "  --threads <n>           search threads (default: 1)\n"
+               "  --order <strategy>      matching order\n"
+               "  --dag-frontier <key>    key of the query DAG builder\n"
+               "  --reorder <ordering>    data graph vertex ordering, "
+               "included in load_ms\n"
+               "  --failing-sets          prune the search with failing sets\n"
+               "  --symmetry              break query automorphisms\n"
+               "  --refine                make the candidate sets arc "
+               "consistent, included\n"
+               "                          in load_ms\n"
+               "  --output <file>         JSON lines results (default: "
+               "benchmark.jsonl)\n"
+               "  --baseline <file>       results of a previous run to "
+               "compare against\n"
+               "  --tolerance <fraction>  allowed slowdown against the "
+               "baseline\n"
+               "                          (default: 0.1; 1 only checks "
+               "timeouts and the\n"
+               "                          number of embeddings)\n";
+}
+
+inline double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+double Median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  size_t n = values.size();
+  return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/*
+ * Runs f warmup times, then repetitions times, and returns the median time
+ * of the timed runs in milliseconds.
+ */
+template <typename F>
+double Measure(const BenchmarkOptions &options, F f) {
+  for (size_t i = 0; i < options.warmup; ++i) f();
+  std::vector<double> times;
+  for (size_t i = 0; i < options.repetitions; ++i) {
+    Clock::time_point start = Clock::now();
+    f();
+    times.push_back(ElapsedMs(start));
+  }
+  return Median(times);
+}
+
+/*
+ * Returns true if name contains one of the comma-separated texts of filter,
+ * or filter is empty.
+ */
+bool MatchesFilter(const std::string &filter, const std::string &name) {
+  if (filter.empty()) return true;
+  std::istringstream stream(filter);
+  std::string text;
+  while (std::getline(stream, text, ','))
+    if (!text.empty() && name.find(text) != std::string::npos) return true;
+  return false;
+}
+
+/*
+ * Every query/<name>.igraph with its data graph data/<first two fields of
+ * name>.igraph and its candidate set candidate_set/<name>.cs, by name.
+ */
+std::vector<Triple> FindTriples(const BenchmarkOptions &options) {
+  std::vector<Triple> triples;
+  std::string query_dir = options.root + "/query";
+  DIR *dir = opendir(query_dir.c_str());
+  if (dir == nullptr) {
+    std::cerr << "Cannot open " << query_dir << "!\n";
+    exit(EXIT_FAILURE);
+  }
+
+  const std::string suffix = ".igraph";
+  while (dirent *entry = readdir(dir)) {
+    std::string file = entry->d_name;
+    if (file.size() <= suffix.size() ||
+        file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0)
+      continue;
+
+    Triple triple;
+    triple.name = file.substr(0, file.size() - suffix.size());
+    if (!MatchesFilter(options.filter, triple.name)) continue;
+
+    size_t second = triple.name.find('_', triple.name.find('_') + 1);
+    triple.data = options.root + "/data/" + triple.name.substr(0, second) +
+                  suffix;
+    triple.query = query_dir + "/" + file;
+    triple.candidate_set =
+        options.root + "/candidate_set/" + triple.name + ".cs";
+    if (std::ifstream(triple.data).is_open() &&
+        std::ifstream(triple.candidate_set).is_open())
+      triples.push_back(triple);
+  }
+  closedir(dir);
+
+  std::sort(triples.begin(), triples.end(),
+            [](const Triple &a, const Triple &b) { return a.name < b.name; });
+  return triples;
+}
+
+/*
+ * Measures one triple and writes its records to fd as they are completed,
+ * so that the records of the caps reached before a timeout are kept.
+ */
+void RunTriple(const BenchmarkOptions &options, const Triple &triple,
+               const Graph &data, double data_load_ms, int fd) {
+  std::unique_ptr<Graph> query;
+  std::unique_ptr<CandidateSet> cs;
+  double load_ms = data_load_ms + Measure(options, [&]() {
+                     query.reset(new Graph(triple.query, data));
+                     cs.reset(new CandidateSet(triple.candidate_set, data));
+                     if (options.refine)
+                       cs->MakeArcConsistent(data, *query,
+                                             options.search.num_threads);
+                   });
+
+  double dag_ms = Measure(options, [&]() {
+    std::unique_ptr<Graph> dag(
+        query->BuildDAG(*cs, options.search.dag_frontier));
+  });
+
+  // from the start of the search to the first embedding
+  double first_ms = Measure(options, [&]() {
+    SearchOptions search = options.search;
+    search.limit = 1;
+    Backtrack backtrack(search);
+    backtrack.FindMatches(data, *query, *cs,
+                          [](const std::vector<Vertex> &) { return false; });
+  });
+
+  for (size_t cap : options.caps) {
+    SearchOptions search = options.search;
+    search.limit = cap;
+    Backtrack backtrack(search);
+    size_t num_matches = 0;
+    double ms = Measure(options, [&]() {
+      num_matches = backtrack.CountMatches(data, *query, *cs);
+    });
+
+    char record[512];
+    int length = snprintf(
+        record, sizeof(record),
+        "{\"query\":\"%s\",\"cap\":%zu,\"load_ms\":%.3f,\"dag_ms\":%.3f,"
+        "\"first_ms\":%.3f,\"embeddings\":%zu,\"ms\":%.3f,"
+        "\"per_second\":%.1f}\n",
+        triple.name.c_str(), cap, load_ms, dag_ms, first_ms, num_matches, ms,
+        ms > 0 ? num_matches * 1000.0 / ms : 0.0);
+    if (write(fd, record, length) != length) return;
+  }
+}
+
+/*
+ * Runs RunTriple in a child process and returns the records it wrote before
+ * it finished or the timeout expired. A query that never terminates cannot
+ * stall the suite.
+ */
+std::vector<std::string> RunWithTimeout(const BenchmarkOptions &options,
+                                        const Triple &triple,
+                                        const Graph &data,
+                                        double data_load_ms) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::cerr << "Cannot create a pipe!\n";
+    exit(EXIT_FAILURE);
+  }
+  fflush(stdout);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    RunTriple(options, triple, data, data_load_ms, fds[1]);
+    close(fds[1]);
+    _exit(EXIT_SUCCESS);
+  }
+  close(fds[1]);
+
+  std::string output;
+  Clock::time_point start = Clock::now();
+  bool finished = false;
+  while (true) {
+    double left = options.timeout * 1000 - ElapsedMs(start);
+    if (left <= 0) break;
+
+    pollfd pfd = {fds[0], POLLIN, 0};
+    if (poll(&pfd, 1, static_cast<int>(left) + 1) <= 0) continue;
+
+    char buffer[4096];
+    ssize_t n = read(fds[0], buffer, sizeof(buffer));
+    if (n <= 0) {
+      finished = true;
+      break;
+    }
+    output.append(buffer, n);
+  }
+  close(fds[0]);
+
+  if (!finished) kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+
+  std::vector<std::string> records;
+  std::istringstream stream(output);
+  std::string line;
+  while (std::getline(stream, line))
+    if (!line.empty()) records.push_back(line);
+  return records;
+}
+
+/*
+ * Extracts the value of a key from a record written by RunTriple.
+ */
+std::string GetField(const std::string &record, const std::string &key) {
+  std::string pattern = "\"" + key + "\":";
+  size_t begin = record.find(pattern);
+  if (begin == std::string::npos) return "";
+  begin += pattern.size();
+  size_t end = record.find_first_of(",}", begin);
+  std::string value = record.substr(begin, end - begin);
+  if (!value.empty() && value[0] == '"')
+    value = value.substr(1, value.size() - 2);
+  return value;
+}
+
+inline std::string GetKey(const std::string &record) {
+  return GetField(record, "query") + "/" + GetField(record, "cap");
+}
+
+/*
+ * Prints the throughput of every record next to its baseline and returns
+ * the number of records that are slower than the tolerance allows, that
+ * timed out or that found a different number of embeddings. Records absent
+ * from this run (e.g. filtered out) are skipped.
+ */
+size_t CompareToBaseline(const BenchmarkOptions &options,
+                         const std::vector<std::string> &records) {
+  std::ifstream fin(options.baseline);
+  if (!fin.is_open()) {
+    std::cerr << "Baseline " << options.baseline << " not found!\n";
+    exit(EXIT_FAILURE);
+  }
+
+  std::map<std::string, std::string> current;
+  for (auto &record : records) current[GetKey(record)] = record;
+
+  size_t num_regressions = 0;
+  std::string base;
+  printf("\n%-24s %12s %12s %8s\n", "query/cap", "baseline/s", "current/s",
+         "ratio");
+  while (std::getline(fin, base)) {
+    if (base.empty()) continue;
+    std::string key = GetKey(base);
+    auto it = current.find(key);
+    if (it == current.end() || GetField(base, "timeout") == "true") continue;
+    bool timed_out = GetField(it->second, "timeout") == "true";
+
+    double before = std::atof(GetField(base, "per_second").c_str());
+    double after =
+        timed_out ? 0 : std::atof(GetField(it->second, "per_second").c_str());
+    double ratio = before > 0 ? after / before : 1;
+    bool mismatch = !timed_out && GetField(base, "embeddings") !=
+                                      GetField(it->second, "embeddings");
+    bool regression = timed_out || ratio < 1 - options.tolerance;
+    num_regressions += regression || mismatch;
+
+    printf("%-24s %12.0f %12.0f %8.2f%s\n", key.c_str(), before, after, ratio,
+           mismatch ? "  EMBEDDINGS DIFFER" : regression ? "  REGRESSION" : "");
+  }
+  return num_regressions;
+}
+
+std::vector<size_t> ParseCaps(const std::string &list) {
+  std::vector<size_t> caps;
+  std::istringstream stream(list);
+  std::string cap;
+  while (std::getline(stream, cap, ','))
+    if (!cap.empty()) caps.push_back(std::stoul(cap));
+  return caps;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  BenchmarkOptions options;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--root" && has_value) {
+      options.root = argv[++i];
+    } else if (arg == "--filter" && has_value) {
+      options.filter = argv[++i];
+    } else if (arg == "--warmup" && has_value) {
+      options.warmup = std::stoul(argv[++i]);
+    } else if (arg == "--repetitions" && has_value) {
+      options.repetitions = std::max<size_t>(1, std::stoul(argv[++i]));
+    } else if (arg == "--caps" && has_value) {
+      options.caps = ParseCaps(argv[++i]);
+    } else if (arg == "--timeout" && has_value) {
+      options.timeout = std::atof(argv[++i]);
+    } else if (arg == "--threads" && has_value) {
+      options.search.num_threads = std::stoul(argv[++i]);
+    } else if (arg == "--order" && has_value) {
+      if (!ParseOrderStrategy(argv[++i], options.search.order)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--dag-frontier" && has_value) {
+      if (!ParseDAGFrontier(argv[++i], options.search.dag_frontier)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--reorder" && has_value) {
+      if (!ParseVertexOrdering(argv[++i], options.ordering)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--refine") {
+      options.refine = true;
+    } else if (arg == "--failing-sets") {
+      options.search.failing_sets = true;
+    } else if (arg == "--symmetry") {
+      options.search.symmetry_breaking = true;
+    } else if (arg == "--output" && has_value) {
+      options.output = argv[++i];
+    } else if (arg == "--baseline" && has_value) {
+      options.baseline = argv[++i];
+    } else if (arg == "--tolerance" && has_value) {
+      options.tolerance = std::atof(argv[++i]);
+    } else {
+      PrintUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<Triple> triples = FindTriples(options);
+  std::vector<std::string> records;
+
+  printf("kernel %s, %zu threads, %zu warmup, %zu repetitions\n",
+         GetMergeKernelName(), GetNumThreads(options.search.num_threads),
+         options.warmup, options.repetitions);
+  printf("%-16s %8s %10s %10s %10s %12s %12s\n", "query", "cap", "load_ms",
+         "dag_ms", "first_ms", "embeddings", "per_second");
+
+  std::string loaded;
+  std::unique_ptr<Graph> data;
+  double data_load_ms = 0;
+
+  for (auto &triple : triples) {
+    // triples are sorted by name, so each data graph is loaded once
+    if (triple.data != loaded) {
+      data_load_ms = Measure(options, [&]() {
+        data.reset(new Graph(triple.data));
+        data->Reorder(options.ordering);
+      });
+      loaded = triple.data;
+    }
+
+    std::vector<std::string> result =
+        RunWithTimeout(options, triple, *data, data_load_ms);
+
+    for (size_t k = 0; k < options.caps.size(); ++k) {
+      if (k < result.size()) {
+        const std::string &r = result[k];
+        printf("%-16s %8s %10s %10s %10s %12s %12s\n", triple.name.c_str(),
+               GetField(r, "cap").c_str(), GetField(r, "load_ms").c_str(),
+               GetField(r, "dag_ms").c_str(), GetField(r, "first_ms").c_str(),
+               GetField(r, "embeddings").c_str(),
+               GetField(r, "per_second").c_str());
+        records.push_back(r);
+      } else {
+        printf("%-16s %8zu %10s\n", triple.name.c_str(), options.caps[k],
+               "timeout");
+        records.push_back("{\"query\":\"" + triple.name +
+                          "\",\"cap\":" + std::to_string(options.caps[k]) +
+                          ",\"timeout\":true}");
+      }
+    }
+    fflush(stdout);
+  }
+
+  std::ofstream fout(options.output, std::ios::trunc);
+  for (auto &record : records) fout << record << "\n";
+  fout.close();
+  printf("results written to %s\n", options.output.c_str());
+
+  if (!options.baseline.empty() && CompareToBaseline(options, records) > 0)
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
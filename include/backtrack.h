@@ -9,18 +9,58 @@
 #include "candidate_set.h"
 #include "common.h"
 #include "graph.h"
+#include "parallel.h"
+#include "search_options.h"
+#include "search_worker.h"
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <queue>
 #include <functional>
 #include <map>
 
+/**
+ * @brief Result of Backtrack::EstimateMatches.
+ */
+struct CountEstimate {
+  // unbiased estimate of the number of embeddings
+  double estimate = 0;
+  // 95% confidence interval of the estimate: the normal approximation if
+  // reliable, otherwise [0, an upper bound], possibly infinite
+  double low = 0;
+  double high = 0;
+  size_t num_samples = 0;
+  // samples whose walk reached an embedding
+  size_t num_successes = 0;
+  // enough walks reached an embedding for the normal interval
+  bool reliable = false;
+};
+
 class Backtrack {
  public:
   Backtrack();
+  explicit Backtrack(const SearchOptions &options);
   ~Backtrack();
 
-  void PrintAllMatches(const Graph &data, const Graph &query,
-                       const CandidateSet &cs);
+  size_t PrintAllMatches(const Graph &data, const Graph &query,
+                         const CandidateSet &cs, FILE *file = stdout);
+  size_t CountMatches(const Graph &data, const Graph &query,
+                      const CandidateSet &cs);
+  size_t FindMatches(const Graph &data, const Graph &query,
+                     const CandidateSet &cs, const MatchCallback &callback);
+  CountEstimate EstimateMatches(const Graph &data, const Graph &query,
+                                const CandidateSet &cs, size_t num_samples,
+                                uint64_t seed = 0);
+
+  bool IsInterrupted() const;
+
+ private:
+  size_t Search(const Graph &data, const Graph &query, const CandidateSet &cs,
+                MatchMode mode, const MatchCallback *callback,
+                OutputSink *sink);
+
+  SearchOptions options_;
+  std::atomic<bool> interrupted_;
 };
 
 #endif  // BACKTRACK_H_
@@ -0,0 +1,102 @@
+/**
+ * @file buffer.h
+ * @brief contiguous array that either owns its elements or borrows them from
+ * externally managed memory (e.g. a memory-mapped snapshot).
+ *
+ */
+
+#ifndef BUFFER_H_
+#define BUFFER_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class Buffer {
+ public:
+  Buffer() : data_(nullptr), size_(0) {}
+  Buffer(const Buffer &other) : owned_(other.begin(), other.end()) { Own(); }
+  Buffer &operator=(const Buffer &other) {
+    if (this != &other) {
+      owned_.assign(other.begin(), other.end());
+      Own();
+    }
+    return *this;
+  }
+  Buffer(Buffer &&other) : data_(nullptr), size_(0) { swap(other); }
+  Buffer &operator=(Buffer &&other) {
+    swap(other);
+    return *this;
+  }
+
+  inline void resize(size_t n) {
+    owned_.resize(n);
+    Own();
+  }
+  inline void resize(size_t n, const T &value) {
+    owned_.resize(n, value);
+    Own();
+  }
+  inline void assign(size_t n, const T &value) {
+    owned_.assign(n, value);
+    Own();
+  }
+  inline void clear() {
+    owned_.clear();
+    Own();
+  }
+
+  /**
+   * @brief Makes the buffer refer to n elements at ptr without copying them.
+   * The memory must outlive the buffer and must not be written through it.
+   *
+   * @param ptr first element.
+   * @param n number of elements.
+   */
+  inline void Borrow(const T *ptr, size_t n) {
+    std::vector<T>().swap(owned_);
+    data_ = const_cast<T *>(ptr);
+    size_ = n;
+  }
+
+  /**
+   * @brief Exchanges the contents of two buffers, owned or borrowed, without
+   * copying them.
+   *
+   * @param other
+   */
+  inline void swap(Buffer &other) {
+    owned_.swap(other.owned_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+  }
+
+  inline bool IsBorrowed() const { return data_ != owned_.data(); }
+
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+
+  inline T *data() { return data_; }
+  inline const T *data() const { return data_; }
+
+  inline T *begin() { return data_; }
+  inline T *end() { return data_ + size_; }
+  inline const T *begin() const { return data_; }
+  inline const T *end() const { return data_ + size_; }
+
+  inline T &operator[](size_t i) { return data_[i]; }
+  inline const T &operator[](size_t i) const { return data_[i]; }
+
+ private:
+  inline void Own() {
+    data_ = owned_.data();
+    size_ = owned_.size();
+  }
+
+  std::vector<T> owned_;
+  T *data_;
+  size_t size_;
+};
+
+#endif  // BUFFER_H_
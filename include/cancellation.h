@@ -0,0 +1,35 @@
+/**
+ * @file cancellation.h
+ * @brief flag that asks a running search to stop.
+ *
+ */
+
+#ifndef CANCELLATION_H_
+#define CANCELLATION_H_
+
+#include <atomic>
+
+/**
+ * @brief Shared between a search and whoever may want to stop it. Cancel
+ * only stores to a lock-free atomic, so it may be called from another thread
+ * or from a signal handler. The search notices it within a few milliseconds,
+ * stops, and flushes the embeddings found so far.
+ */
+class CancellationToken {
+ public:
+  CancellationToken() : cancelled_(false) {}
+
+  CancellationToken(const CancellationToken &) = delete;
+  CancellationToken &operator=(const CancellationToken &) = delete;
+
+  inline void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+  inline void Reset() { cancelled_.store(false, std::memory_order_relaxed); }
+  inline bool IsCancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> cancelled_;
+};
+
+#endif  // CANCELLATION_H_
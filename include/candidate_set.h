@@ -6,20 +6,92 @@
 #ifndef CANDIDATE_SET_H_
 #define CANDIDATE_SET_H_
 
+#include "buffer.h"
 #include "common.h"
+#include "mapped_file.h"
 
+#include <cstdint>
+#include <memory>
+
+class Graph;
+
+/**
+ * @brief What CandidateSet::MakeArcConsistent removed.
+ */
+struct RefinementReport {
+  size_t num_candidates_before = 0;
+  size_t num_candidates_after = 0;
+  // candidates whose label, degree or neighbor label frequencies do not fit
+  size_t num_local_removals = 0;
+  // candidates without an adjacent candidate of some query neighbor
+  size_t num_arc_removals = 0;
+  // passes over the query vertices until nothing changed
+  size_t num_rounds = 0;
+};
+
+/**
+ * @brief Candidate data vertices of every query vertex, stored flat: the
+ * candidates of u are candidates_[offset_[u]] .. candidates_[offset_[u + 1]).
+ *
+ * Candidate sets are read from the text format
+ *
+ *   t <number of query vertices>
+ *   c <query vertex> <number of candidates> <candidate> ...
+ *
+ * or from the binary format written by SaveBinary (.csb), which is mapped and
+ * used in place. Both hold the vertex ids of the data graph file.
+ */
 class CandidateSet {
  public:
   explicit CandidateSet(const std::string& filename);
+  CandidateSet(const std::string& filename, const Graph& data);
+  CandidateSet(const Graph& data, const Graph& query);
   ~CandidateSet();
 
+  inline size_t GetNumQueryVertices() const;
   inline size_t GetCandidateSize(Vertex u) const;
   inline Vertex GetCandidate(Vertex u, size_t i) const;
+  inline const Vertex* GetCandidates(Vertex u) const;
+
+  RefinementReport MakeArcConsistent(const Graph& data, const Graph& query,
+                                     size_t num_threads);
+
+  void BuildMembership(size_t num_data_vertices);
+  inline bool HasMembership() const;
+  inline bool IsCandidate(Vertex u, Vertex v) const;
+
+  void CheckFits(const Graph& data, const Graph& query) const;
+
+  void SaveBinary(const std::string& filename, const Graph& data) const;
+  static bool IsBinary(const std::string& filename);
 
  private:
-  std::vector<std::vector<Vertex>> cs_;
+  void LoadText(const std::string& filename);
+  void LoadBinary(const std::string& filename);
+  void Refine(const Graph& data, const Graph& query, const Graph& dag,
+              const std::vector<Vertex>& order, bool use_children);
+  void Compact(const std::vector<size_t>& size);
+
+  Buffer<size_t> offset_;
+  Buffer<Vertex> candidates_;
+
+  // bit v of membership_[u * membership_words_ ..] is set if v is a candidate
+  // of u; empty until BuildMembership
+  size_t membership_words_ = 0;
+  std::vector<uint64_t> membership_;
+
+  // keeps a binary file mapped while the buffers above borrow from it
+  std::shared_ptr<MappedFile> file_;
 };
 
+/**
+ * @brief Returns the number of query vertices.
+ *
+ * @return size_t
+ */
+inline size_t CandidateSet::GetNumQueryVertices() const {
+  return offset_.empty() ? 0 : offset_.size() - 1;
+}
 /**
  * @brief Returns the number of data vertices that may be mapped to query vertex
  * u.
@@ -28,7 +100,7 @@ class CandidateSet {
  * @return size_t
  */
 inline size_t CandidateSet::GetCandidateSize(Vertex u) const {
-  return cs_[u].size();
+  return offset_[u + 1] - offset_[u];
 }
 /**
  * @brief Returns the i-th candidate from query vertex u's candidate set.
@@ -38,7 +110,34 @@ inline size_t CandidateSet::GetCandidateSize(Vertex u) const {
  * @return Vertex
  */
 inline Vertex CandidateSet::GetCandidate(Vertex u, size_t i) const {
-  return cs_[u][i];
+  return candidates_[offset_[u] + i];
+}
+/**
+ * @brief Returns the first of the GetCandidateSize(u) candidates of u.
+ *
+ * @param u query vertex id.
+ * @return const Vertex*
+ */
+inline const Vertex* CandidateSet::GetCandidates(Vertex u) const {
+  return candidates_.begin() + offset_[u];
+}
+
+/**
+ * @brief Returns true once BuildMembership was called.
+ *
+ * @return bool
+ */
+inline bool CandidateSet::HasMembership() const { return !membership_.empty(); }
+/**
+ * @brief Returns true if v is a candidate of u, in O(1). Needs
+ * BuildMembership.
+ *
+ * @param u query vertex id.
+ * @param v data vertex id.
+ * @return bool
+ */
+inline bool CandidateSet::IsCandidate(Vertex u, Vertex v) const {
+  return membership_[u * membership_words_ + v / 64] >> (v % 64) & 1;
 }
 
 #endif  // CANDIDATE_SET_H_
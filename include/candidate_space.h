@@ -0,0 +1,86 @@
+/**
+ * @file candidate_space.h
+ * @brief adjacency between the candidates of adjacent query vertices.
+ *
+ */
+
+#ifndef CANDIDATE_SPACE_H_
+#define CANDIDATE_SPACE_H_
+
+#include "candidate_set.h"
+#include "common.h"
+#include "graph.h"
+
+/**
+ * @brief For every DAG edge (p, c) and every candidate C(p)[i], the sorted
+ * positions j such that C(c)[j] is adjacent to C(p)[i] in the data graph.
+ *
+ * A DAG edge is identified by its offset in the parent array of the DAG,
+ * i.e. the edge from GetParent(e) to c for e in [GetParentStartOffset(c),
+ * GetParentEndOffset(c)). With the index, the candidates of a child that are
+ * adjacent to the data vertices of all its parents are the intersection of
+ * one precomputed list per parent.
+ */
+class CandidateSpace {
+ public:
+  CandidateSpace(const Graph &data, const Graph &dag, const CandidateSet &cs,
+                 size_t num_threads = 1);
+  ~CandidateSpace();
+
+  inline const uint32_t *GetAdjacentBegin(size_t edge, size_t i) const;
+  inline const uint32_t *GetAdjacentEnd(size_t edge, size_t i) const;
+  inline size_t GetAdjacentSize(size_t edge, size_t i) const;
+
+  inline size_t GetNumEntries() const;
+
+ private:
+  // offsets_[edge_offset_[e] + i] .. offsets_[edge_offset_[e] + i + 1] is the
+  // range of positions_ for candidate i of the parent of edge e
+  std::vector<size_t> edge_offset_;
+  std::vector<size_t> offsets_;
+  std::vector<uint32_t> positions_;
+};
+
+/**
+ * @brief Returns the first position of the candidates of the child of edge
+ * that are adjacent to candidate i of the parent of edge.
+ *
+ * @param edge offset of the edge in the DAG parent array.
+ * @param i index of a candidate of the parent.
+ * @return const uint32_t*
+ */
+inline const uint32_t *CandidateSpace::GetAdjacentBegin(size_t edge,
+                                                        size_t i) const {
+  return positions_.data() + offsets_[edge_offset_[edge] + i];
+}
+/**
+ * @brief Returns the end of the range started by GetAdjacentBegin.
+ *
+ * @param edge offset of the edge in the DAG parent array.
+ * @param i index of a candidate of the parent.
+ * @return const uint32_t*
+ */
+inline const uint32_t *CandidateSpace::GetAdjacentEnd(size_t edge,
+                                                      size_t i) const {
+  return positions_.data() + offsets_[edge_offset_[edge] + i + 1];
+}
+/**
+ * @brief Returns the number of adjacent candidates of the child of edge.
+ *
+ * @param edge offset of the edge in the DAG parent array.
+ * @param i index of a candidate of the parent.
+ * @return size_t
+ */
+inline size_t CandidateSpace::GetAdjacentSize(size_t edge, size_t i) const {
+  return offsets_[edge_offset_[edge] + i + 1] - offsets_[edge_offset_[edge] + i];
+}
+/**
+ * @brief Returns the number of candidate-space edges stored in the index.
+ *
+ * @return size_t
+ */
+inline size_t CandidateSpace::GetNumEntries() const {
+  return positions_.size();
+}
+
+#endif  // CANDIDATE_SPACE_H_
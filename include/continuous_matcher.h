@@ -0,0 +1,118 @@
+/**
+ * @file continuous_matcher.h
+ * @brief standing queries over a dynamic data graph, reporting the
+ * embeddings every update creates or destroys.
+ *
+ */
+
+#ifndef CONTINUOUS_MATCHER_H_
+#define CONTINUOUS_MATCHER_H_
+
+#include "common.h"
+#include "dynamic_graph.h"
+#include "graph.h"
+
+#include <functional>
+#include <memory>
+
+/**
+ * @brief One change of the data graph.
+ */
+struct GraphUpdate {
+  enum Type { kAddVertex, kRemoveVertex, kAddEdge, kRemoveEdge };
+
+  Type type;
+  // the vertex, or the endpoints of the edge
+  Vertex v1 = -1;
+  Vertex v2 = -1;
+  // label in the graph files of an added vertex
+  Label label = -1;
+};
+
+bool ParseGraphUpdate(const std::string &line, GraphUpdate &update);
+
+/**
+ * @brief Receives every embedding an update creates (created = true) or
+ * destroys, with the index of its query.
+ */
+using DeltaCallback = std::function<void(
+    size_t query, bool created, const std::vector<Vertex> &embedding)>;
+
+/**
+ * @brief Keeps the embeddings of registered queries up to date with a data
+ * graph under updates, without searching the whole graph again.
+ *
+ * Updates are applied one at a time. An embedding created by inserting the
+ * edge (a, b) maps exactly one query edge (x, y) to it, one way, so the new
+ * embeddings are found by matching every ordered query edge (x, y) to (a, b)
+ * and extending from there, after the insertion; the destroyed ones are
+ * found the same way before a deletion. Each embedding is reported once, by
+ * the update that creates or destroys it. Removing a vertex removes its
+ * edges first. The extension order of each anchored query edge, and the
+ * matched neighbors every extension must be adjacent to, are computed when
+ * the query is registered.
+ */
+class ContinuousMatcher {
+ public:
+  explicit ContinuousMatcher(const Graph &data);
+  ~ContinuousMatcher();
+
+  size_t AddQuery(const std::string &filename);
+  inline size_t GetNumQueries() const;
+  inline const DynamicGraph &GetGraph() const;
+
+  bool Apply(const GraphUpdate &update, const DeltaCallback &callback);
+  size_t ApplyBatch(const std::vector<GraphUpdate> &updates,
+                    const DeltaCallback &callback);
+
+ private:
+  /**
+   * @brief Extension order of a query with its first two vertices matched to
+   * the endpoints of an edge: order[k] is adjacent to the vertices
+   * backward[backward_offset[k]] .. backward[backward_offset[k + 1]) of
+   * order[0 .. k).
+   */
+  struct AnchoredOrder {
+    std::vector<Vertex> order;
+    std::vector<size_t> backward_offset;
+    std::vector<Vertex> backward;
+  };
+
+  struct Query {
+    std::unique_ptr<Graph> graph;
+    std::vector<AnchoredOrder> orders;
+  };
+
+  AnchoredOrder BuildOrder(const Graph &query, Vertex x, Vertex y) const;
+  void MatchEdge(Vertex a, Vertex b, bool created,
+                 const DeltaCallback &callback);
+  void MatchVertex(Vertex v, bool created, const DeltaCallback &callback);
+  void Extend(size_t query, const AnchoredOrder &order, size_t k,
+              bool created, const DeltaCallback &callback);
+
+  DynamicGraph graph_;
+  std::vector<Query> queries_;
+
+  // data vertex of each query vertex, and whether each data vertex is used
+  std::vector<Vertex> embedding_;
+  std::vector<char> used_;
+};
+
+/**
+ * @brief Returns the number of registered queries.
+ *
+ * @return size_t
+ */
+inline size_t ContinuousMatcher::GetNumQueries() const {
+  return queries_.size();
+}
+/**
+ * @brief Returns the data graph with the updates applied so far.
+ *
+ * @return const DynamicGraph&
+ */
+inline const DynamicGraph &ContinuousMatcher::GetGraph() const {
+  return graph_;
+}
+
+#endif  // CONTINUOUS_MATCHER_H_
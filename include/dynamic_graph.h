@@ -0,0 +1,128 @@
+/**
+ * @file dynamic_graph.h
+ * @brief data graph that accepts vertex and edge insertions and deletions.
+ *
+ */
+
+#ifndef DYNAMIC_GRAPH_H_
+#define DYNAMIC_GRAPH_H_
+
+#include "buffer.h"
+#include "common.h"
+#include "graph.h"
+
+/**
+ * @brief Updatable copy of a data graph, in the vertex ids and labels of its
+ * file. The neighbors of every vertex are kept sorted by label, then by id,
+ * so that the neighbors with a label are one range and adjacency is a binary
+ * search; an update costs O(degree).
+ *
+ * Removed vertices keep their id with label -1 and no neighbors, so that the
+ * ids of the other vertices do not change. Labels the data graph file does
+ * not have are given new labels when they first appear.
+ */
+class DynamicGraph {
+ public:
+  explicit DynamicGraph(const Graph &graph);
+  ~DynamicGraph();
+
+  inline size_t GetNumVertices() const;
+  inline size_t GetNumEdges() const;
+
+  inline bool HasVertex(Vertex v) const;
+  inline Label GetLabel(Vertex v) const;
+  inline size_t GetDegree(Vertex v) const;
+  inline const Vertex *GetNeighborBegin(Vertex v) const;
+  inline const Vertex *GetNeighborEnd(Vertex v) const;
+  std::pair<const Vertex *, const Vertex *> GetNeighbors(Vertex v,
+                                                         Label l) const;
+  bool IsNeighbor(Vertex u, Vertex v) const;
+
+  bool AddVertex(Vertex v, Label raw_label);
+  bool RemoveVertex(Vertex v);
+  bool AddEdge(Vertex u, Vertex v);
+  bool RemoveEdge(Vertex u, Vertex v);
+
+  Label AddLabel(Label raw_label);
+  inline const Buffer<Label> &GetLabelMap() const;
+
+ private:
+  std::vector<Vertex>::iterator FindNeighbor(Vertex u, Vertex v);
+
+  size_t num_edges_;
+  // -1 for removed vertices
+  std::vector<Label> label_;
+  std::vector<std::vector<Vertex>> adj_;
+
+  // label of the graph files -> label, -1 for labels not seen yet
+  Buffer<Label> label_map_;
+  Label num_labels_;
+};
+
+/**
+ * @brief Returns the number of vertex ids, removed vertices included.
+ *
+ * @return size_t
+ */
+inline size_t DynamicGraph::GetNumVertices() const { return label_.size(); }
+/**
+ * @brief Returns the number of edges.
+ *
+ * @return size_t
+ */
+inline size_t DynamicGraph::GetNumEdges() const { return num_edges_; }
+
+/**
+ * @brief Returns true if v is a vertex of the graph.
+ *
+ * @param v vertex id.
+ * @return bool
+ */
+inline bool DynamicGraph::HasVertex(Vertex v) const {
+  return v >= 0 && static_cast<size_t>(v) < label_.size() && label_[v] >= 0;
+}
+/**
+ * @brief Returns the label of the vertex v, -1 if it was removed.
+ *
+ * @param v vertex id.
+ * @return Label
+ */
+inline Label DynamicGraph::GetLabel(Vertex v) const { return label_[v]; }
+/**
+ * @brief Returns the degree of the vertex v.
+ *
+ * @param v vertex id.
+ * @return size_t
+ */
+inline size_t DynamicGraph::GetDegree(Vertex v) const {
+  return adj_[v].size();
+}
+/**
+ * @brief Returns the first neighbor of v.
+ *
+ * @param v vertex id.
+ * @return const Vertex*
+ */
+inline const Vertex *DynamicGraph::GetNeighborBegin(Vertex v) const {
+  return adj_[v].data();
+}
+/**
+ * @brief Returns the end of the neighbors of v.
+ *
+ * @param v vertex id.
+ * @return const Vertex*
+ */
+inline const Vertex *DynamicGraph::GetNeighborEnd(Vertex v) const {
+  return adj_[v].data() + adj_[v].size();
+}
+
+/**
+ * @brief Returns the label map, to load query graphs with.
+ *
+ * @return const Buffer<Label>&
+ */
+inline const Buffer<Label> &DynamicGraph::GetLabelMap() const {
+  return label_map_;
+}
+
+#endif  // DYNAMIC_GRAPH_H_
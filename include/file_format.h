@@ -0,0 +1,96 @@
+/**
+ * @file file_format.h
+ * @brief helpers shared by the readers and writers of the text and binary
+ * file formats (graphs, snapshots and candidate sets).
+ *
+ */
+
+#ifndef FILE_FORMAT_H_
+#define FILE_FORMAT_H_
+
+#include "buffer.h"
+#include "common.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+inline const char *SkipSpaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+  return p;
+}
+
+inline const char *SkipLine(const char *p, const char *end) {
+  while (p < end && *p != '\n') ++p;
+  return p < end ? p + 1 : end;
+}
+
+/*
+ * Parses a decimal integer starting at the first non-blank character of p.
+ * Returns the position right after the last digit.
+ */
+template <typename T>
+inline const char *ParseInt(const char *p, const char *end, T &value) {
+  p = SkipSpaces(p, end);
+  bool negative = false;
+  if (p < end && *p == '-') {
+    negative = true;
+    ++p;
+  }
+  T result = 0;
+  while (p < end && static_cast<unsigned>(*p - '0') < 10) {
+    result = result * 10 + (*p - '0');
+    ++p;
+  }
+  value = negative ? -result : result;
+  return p;
+}
+
+/*
+ * Binary files store every array at an 8-byte aligned offset from the
+ * beginning of the file, so that the mapped file can be used in place.
+ */
+inline uint64_t AlignUp(uint64_t offset) { return (offset + 7) & ~7ULL; }
+
+template <typename T>
+void WriteArray(std::ofstream &fout, const Buffer<T> &array, uint64_t offset) {
+  fout.seekp(offset);
+  fout.write(reinterpret_cast<const char *>(array.data()),
+             array.size() * sizeof(T));
+}
+
+/*
+ * Binary files are written to filename + ".tmp" and renamed over filename
+ * only once every write succeeded. The target may be the very file the data
+ * was mapped from, which truncating in place would destroy before it is read.
+ */
+inline std::string TempFileName(const std::string &filename) {
+  return filename + ".tmp";
+}
+
+inline void CommitFile(std::ofstream &fout, const std::string &filename) {
+  std::string temp = TempFileName(filename);
+  fout.close();
+
+  if (!fout) {
+    std::remove(temp.c_str());
+    throw std::runtime_error("Cannot write " + filename + "!");
+  }
+  if (std::rename(temp.c_str(), filename.c_str()) != 0) {
+    std::remove(temp.c_str());
+    throw std::runtime_error("Cannot replace " + filename + "!");
+  }
+}
+
+template <typename T>
+void BorrowArray(const MappedFile &file, uint64_t offset, size_t n,
+                 Buffer<T> &array) {
+  if (offset + n * sizeof(T) > file.GetSize())
+    throw std::runtime_error("Binary file is truncated!");
+  array.Borrow(reinterpret_cast<const T *>(file.GetData() + offset), n);
+}
+
+#endif  // FILE_FORMAT_H_
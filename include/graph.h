@@ -6,12 +6,88 @@
 #ifndef GRAPH_H_
 #define GRAPH_H_
 
+#include "buffer.h"
 #include "common.h"
 #include "candidate_set.h"
+#include "mapped_file.h"
+
+#include <memory>
+
+/**
+ * @brief Order in which the vertices of a data graph are renumbered after
+ * loading, to place vertices that are accessed together close in memory.
+ */
+enum class VertexOrdering {
+  kNone,
+  // by label, then by descending degree: the candidates of a query vertex
+  // form a few contiguous ranges
+  kLabelDegree,
+  // breadth-first from the highest degree vertex of each component
+  kBFS,
+  // reverse Cuthill-McKee, which keeps the ids of neighbors close
+  kRCM,
+};
+
+/**
+ * @brief Parses "none", "label-degree", "bfs" or "rcm".
+ *
+ * @param name
+ * @param ordering set to the parsed ordering.
+ * @return false if the name is unknown.
+ */
+inline bool ParseVertexOrdering(const std::string &name,
+                                VertexOrdering &ordering) {
+  if (name == "none")
+    ordering = VertexOrdering::kNone;
+  else if (name == "label-degree")
+    ordering = VertexOrdering::kLabelDegree;
+  else if (name == "bfs")
+    ordering = VertexOrdering::kBFS;
+  else if (name == "rcm")
+    ordering = VertexOrdering::kRCM;
+  else
+    return false;
+  return true;
+}
+
+/**
+ * @brief Key by which BuildDAG picks the next vertex among the neighbors of
+ * the visited ones; the smallest key is visited first.
+ */
+enum class DAGFrontier {
+  // the key of the original DAF builder: |C(u)| divided by deg(u) less the
+  // number of visited vertices whose ids fall in the range of adjacency
+  // offsets of u, taken when u is first reached and whenever another
+  // neighbor of u is visited. The count was meant to be the visited
+  // neighbors of u, but the matching orders are tuned on these DAGs.
+  kLegacy,
+  // |C(u)| divided by the number of unvisited neighbors of u, updated as
+  // they are visited; vertices with none left go last
+  kUnvisited,
+};
+
+/**
+ * @brief Parses "legacy" or "unvisited".
+ *
+ * @param name
+ * @param frontier set to the parsed key.
+ * @return false if the name is unknown.
+ */
+inline bool ParseDAGFrontier(const std::string &name, DAGFrontier &frontier) {
+  if (name == "legacy")
+    frontier = DAGFrontier::kLegacy;
+  else if (name == "unvisited")
+    frontier = DAGFrontier::kUnvisited;
+  else
+    return false;
+  return true;
+}
 
 class Graph {
  public:
   explicit Graph(const std::string& filename, bool is_query = false);
+  Graph(const std::string& filename, const Graph& data);
+  Graph(const std::string& filename, const Buffer<Label>& label_map);
   ~Graph();
 
   inline int32_t GetGraphID() const;
@@ -32,6 +108,7 @@ class Graph {
   inline size_t GetNeighborEndOffset(Vertex v, Label l) const;
 
   inline Label GetLabel(Vertex v) const;
+  inline const Buffer<Label>& GetLabelMap() const;
   inline Vertex GetNeighbor(size_t offset) const;
 
   inline bool IsNeighbor(Vertex u, Vertex v) const;
@@ -42,32 +119,77 @@ class Graph {
   inline bool IsParent(Vertex u, Vertex v) const;
   inline bool IsChild(Vertex u, Vertex v) const;
   inline Vertex GetRoot() const;
+  inline size_t GetLayer(Vertex v) const;
+  inline size_t GetNumLayers() const;
+
+  Graph *BuildDAG(const CandidateSet &cs,
+                  DAGFrontier frontier = DAGFrontier::kLegacy) const;
+  std::vector<Vertex> GetTopologicalOrder() const;
 
-  Graph *BuildDAG(const CandidateSet &cs) const;
-  
+  void Reorder(VertexOrdering ordering);
+  inline bool IsReordered() const;
+  inline Vertex GetOriginalID(Vertex v) const;
+  inline Vertex GetVertexID(Vertex original) const;
+
+  void SaveSnapshot(const std::string &filename) const;
+  static bool IsSnapshot(const std::string &filename);
 
  private:
+  /**
+   * @brief Neighbors of a vertex that share a label. offset is relative to
+   * the first neighbor of the vertex, so that it always fits in 32 bits.
+   */
+  struct LabelRun {
+    Label label;
+    uint32_t offset;
+  };
+
   explicit Graph();
+  void Load(const std::string &filename, const Buffer<Label> *label_map);
+  void LoadSnapshot(const std::string &filename);
+  void SortNeighbors(size_t num_threads);
+  void BuildLabelRuns(size_t num_threads);
+
+  inline const LabelRun *FindLabelRun(Vertex v, Label l) const;
+
   int32_t graph_id_;
 
   size_t num_vertices_;
   size_t num_edges_;
   size_t num_labels_;
 
-  std::vector<size_t> label_frequency_;
+  Buffer<size_t> label_frequency_;
 
-  std::vector<size_t> start_offset_;
-  std::vector<std::pair<size_t, size_t>> start_offset_by_label_;
+  Buffer<size_t> start_offset_;
 
-  std::vector<Label> label_;
-  std::vector<Vertex> adj_array_;
+  // the label runs of v are label_runs_[label_run_offset_[v] ..
+  // label_run_offset_[v + 1]), sorted by label
+  Buffer<size_t> label_run_offset_;
+  Buffer<LabelRun> label_runs_;
+
+  Buffer<Label> label_;
+  Buffer<Vertex> adj_array_;
 
   std::vector<size_t> start_offset_par_;
   std::vector<Vertex> par_array_;
 
   Label max_label_;
 
+  // raw data graph label -> label, -1 for labels absent from the data graph
+  Buffer<Label> label_map_;
+
+  // vertex id -> id in the input file and back, empty unless reordered
+  Buffer<Vertex> original_id_;
+  Buffer<Vertex> vertex_id_;
+
   Vertex root;
+
+  // breadth-first distance from the root to each vertex (DAG only)
+  std::vector<size_t> layer_;
+  size_t num_layers_ = 0;
+
+  // keeps the snapshot mapped while the buffers above borrow from it
+  std::shared_ptr<MappedFile> snapshot_;
 };
 
 /**
@@ -152,7 +274,8 @@ inline size_t Graph::GetNeighborEndOffset(Vertex v) const {
  * @return size_t
  */
 inline size_t Graph::GetNeighborStartOffset(Vertex v, Label l) const {
-  return start_offset_by_label_[v * (max_label_ + 1) + l].first;
+  const LabelRun *run = FindLabelRun(v, l);
+  return run ? start_offset_[v] + run->offset : 0;
 }
 /**
  * @brief Returns the end offset of the neighbor of v with label l. If there is
@@ -163,7 +286,36 @@ inline size_t Graph::GetNeighborStartOffset(Vertex v, Label l) const {
  * @return size_t
  */
 inline size_t Graph::GetNeighborEndOffset(Vertex v, Label l) const {
-  return start_offset_by_label_[v * (max_label_ + 1) + l].second;
+  const LabelRun *run = FindLabelRun(v, l);
+  if (run == nullptr) return 0;
+  if (run + 1 == label_runs_.begin() + label_run_offset_[v + 1])
+    return start_offset_[v + 1];
+  return start_offset_[v] + run[1].offset;
+}
+
+/**
+ * @brief Returns the run of the neighbors of v with label l, or nullptr if v
+ * has no such neighbor. Short run lists are scanned, longer ones are binary
+ * searched.
+ *
+ * @param v vertex id.
+ * @param l label of v's neighbor.
+ * @return const LabelRun*
+ */
+inline const Graph::LabelRun *Graph::FindLabelRun(Vertex v, Label l) const {
+  const LabelRun *begin = label_runs_.begin() + label_run_offset_[v];
+  const LabelRun *end = label_runs_.begin() + label_run_offset_[v + 1];
+
+  if (end - begin > 8) {
+    begin = std::lower_bound(
+        begin, end, l,
+        [](const LabelRun &run, Label l) { return run.label < l; });
+    return begin != end && begin->label == l ? begin : nullptr;
+  }
+
+  for (; begin != end && begin->label <= l; ++begin)
+    if (begin->label == l) return begin;
+  return nullptr;
 }
 
 /**
@@ -173,6 +325,13 @@ inline size_t Graph::GetNeighborEndOffset(Vertex v, Label l) const {
  * @return Label
  */
 inline Label Graph::GetLabel(Vertex v) const { return label_[v]; }
+/**
+ * @brief Returns the map of the labels of the data graph file to labels,
+ * -1 for labels absent from the data graph (data graphs only).
+ *
+ * @return const Buffer<Label>&
+ */
+inline const Buffer<Label> &Graph::GetLabelMap() const { return label_map_; }
 /**
  * @brief Returns the neighbor of a vertex v from the offset where the offset is
  * in half-open interval [GetNeighborStartOffset(v), GetNeighborEndOffset(v))
@@ -197,18 +356,17 @@ inline bool Graph::IsNeighbor(Vertex u, Vertex v) const {
   if (GetNeighborLabelFrequency(u, GetLabel(v)) >
       GetNeighborLabelFrequency(v, GetLabel(u)))
     std::swap(u, v);
+  size_t begin = GetNeighborStartOffset(u, GetLabel(v));
+  size_t end = GetNeighborEndOffset(u, GetLabel(v));
   auto it = std::lower_bound(
-      adj_array_.begin() + GetNeighborStartOffset(u, GetLabel(v)),
-      adj_array_.begin() + GetNeighborEndOffset(u, GetLabel(v)), v,
+      adj_array_.begin() + begin, adj_array_.begin() + end, v,
       [this](Vertex u, Vertex v) {
         if (GetDegree(u) != GetDegree(v))
           return GetDegree(u) > GetDegree(v);
         else
           return u < v;
       });
-  size_t offset = it - adj_array_.begin();
-  return offset >= GetNeighborStartOffset(u, GetLabel(v)) &&
-         offset < GetNeighborEndOffset(u, GetLabel(v)) && *it == v;
+  return it != adj_array_.begin() + end && *it == v;
 }
 
 inline size_t Graph::GetParentStartOffset(Vertex v) const {
@@ -243,4 +401,47 @@ inline Vertex Graph::GetRoot() const {
   return root;
 }
 
+/**
+ * @brief Returns the layer of v in a DAG built by BuildDAG, i.e. its
+ * breadth-first distance from the root in the query graph.
+ *
+ * @param v vertex id.
+ * @return size_t
+ */
+inline size_t Graph::GetLayer(Vertex v) const { return layer_[v]; }
+/**
+ * @brief Returns the number of layers of a DAG built by BuildDAG.
+ *
+ * @return size_t
+ */
+inline size_t Graph::GetNumLayers() const { return num_layers_; }
+
+/**
+ * @brief Returns true if the vertices were renumbered by Reorder.
+ *
+ * @return bool
+ */
+inline bool Graph::IsReordered() const { return !original_id_.empty(); }
+/**
+ * @brief Returns the id of v in the input file.
+ *
+ * @param v vertex id.
+ * @return Vertex
+ */
+inline Vertex Graph::GetOriginalID(Vertex v) const {
+  return IsReordered() ? original_id_[v] : v;
+}
+/**
+ * @brief Returns the id of the vertex whose id in the input file is
+ * original, or -1 if there is no such vertex.
+ *
+ * @param original vertex id in the input file.
+ * @return Vertex
+ */
+inline Vertex Graph::GetVertexID(Vertex original) const {
+  if (original < 0 || static_cast<size_t>(original) >= num_vertices_)
+    return -1;
+  return IsReordered() ? vertex_id_[original] : original;
+}
+
 #endif  // GRAPH_H_
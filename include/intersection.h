@@ -0,0 +1,37 @@
+/**
+ * @file intersection.h
+ * @brief intersection of sorted arrays of distinct 32-bit integers.
+ *
+ */
+
+#ifndef INTERSECTION_H_
+#define INTERSECTION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// extra elements the output of an intersection may be written past its end
+const size_t kIntersectPadding = 8;
+
+/**
+ * @brief Signature of an intersection kernel. Writes the common elements of
+ * a and b to out in ascending order and returns their number. out must not
+ * overlap a or b and must have room for min(na, nb) + kIntersectPadding
+ * elements.
+ */
+using IntersectKernel = size_t (*)(const uint32_t *a, size_t na,
+                                   const uint32_t *b, size_t nb,
+                                   uint32_t *out);
+
+size_t IntersectMerge(const uint32_t *a, size_t na, const uint32_t *b,
+                      size_t nb, uint32_t *out);
+size_t IntersectGalloping(const uint32_t *a, size_t na, const uint32_t *b,
+                          size_t nb, uint32_t *out);
+
+IntersectKernel GetMergeKernel();
+const char *GetMergeKernelName();
+
+size_t Intersect(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                 uint32_t *out);
+
+#endif  // INTERSECTION_H_
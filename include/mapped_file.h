@@ -0,0 +1,45 @@
+/**
+ * @file mapped_file.h
+ * @brief read-only memory mapping of a whole file.
+ *
+ */
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include "common.h"
+
+/**
+ * @brief Maps a whole file read-only; the constructor throws
+ * std::runtime_error if the file cannot be opened or mapped.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  inline const char *GetData() const;
+  inline size_t GetSize() const;
+
+ private:
+  const char *data_;
+  size_t size_;
+};
+
+/**
+ * @brief Returns the first byte of the mapping.
+ *
+ * @return const char*
+ */
+inline const char *MappedFile::GetData() const { return data_; }
+/**
+ * @brief Returns the size of the mapped file in bytes.
+ *
+ * @return size_t
+ */
+inline size_t MappedFile::GetSize() const { return size_; }
+
+#endif  // MAPPED_FILE_H_
@@ -0,0 +1,123 @@
+/**
+ * @file matching_order.h
+ * @brief strategies that choose the next query vertex to match.
+ *
+ */
+
+#ifndef MATCHING_ORDER_H_
+#define MATCHING_ORDER_H_
+
+#include "candidate_set.h"
+#include "candidate_space.h"
+#include "common.h"
+#include "graph.h"
+#include "search_options.h"
+
+/**
+ * @brief Priority of an extendable query vertex; the smallest key is matched
+ * next. Keys compare by group, then cost, then tie.
+ */
+struct OrderKey {
+  int group;
+  double cost;
+  size_t tie;
+
+  inline bool operator<(const OrderKey &other) const {
+    if (group != other.group) return group < other.group;
+    if (cost != other.cost) return cost < other.cost;
+    return tie < other.tie;
+  }
+};
+
+/**
+ * @brief Data shared by the workers of one search to rank the extendable
+ * query vertices: the static order and, for the path-size based
+ * strategies, the DAF weight of every candidate [1].
+ *
+ * The weight of candidate i of u is 1 if u has no child in the DAG whose
+ * only parent is u. Otherwise it is the minimum, over such children c, of
+ * the sum of the weights of the candidates of c adjacent to C(u)[i]. It
+ * estimates the number of embeddings of the tree-like paths below u.
+ *
+ * The static order is a topological order of the DAG that starts at the
+ * root and greedily takes the vertex with the most neighbors already
+ * ordered, then the most neighbors adjacent to ordered vertices, then the
+ * fewest candidates (RI [2] with a GraphQL-like tie-break).
+ *
+ * With postpone_leaves, the leaves of the DAG (other than the root) are left
+ * out of the search: the candidates of a leaf depend only on its parents,
+ * and leaves are never adjacent to each other, so their assignments can be
+ * counted or enumerated once everything else is matched.
+ */
+class MatchingOrder {
+ public:
+  MatchingOrder(const Graph &dag, const CandidateSet &cs,
+                const CandidateSpace &space, OrderStrategy strategy,
+                bool postpone_leaves = false);
+  ~MatchingOrder();
+
+  OrderKey GetKey(Vertex u, const uint32_t *candidates, size_t n) const;
+
+  inline const std::vector<Vertex> &GetStaticOrder() const;
+  inline bool IsPostponed(Vertex u) const;
+  inline const std::vector<char> &GetPostponed() const;
+  inline double GetWeight(Vertex u, uint32_t i) const;
+
+ private:
+  void BuildStaticOrder(const Graph &dag, const CandidateSet &cs);
+  void BuildWeights(const Graph &dag, const CandidateSet &cs,
+                    const CandidateSpace &space);
+
+  const OrderStrategy strategy_;
+
+  std::vector<Vertex> static_order_;
+  // position of each query vertex in static_order_
+  std::vector<size_t> rank_;
+  std::vector<char> is_leaf_;
+  // 1 for the query vertices left out of the search
+  std::vector<char> postponed_;
+
+  // weights_[weight_offset_[u] + i] is the weight of candidate i of u
+  std::vector<size_t> weight_offset_;
+  std::vector<double> weights_;
+};
+
+/**
+ * @brief Returns the static order (the root first).
+ *
+ * @return const std::vector<Vertex>&
+ */
+inline const std::vector<Vertex> &MatchingOrder::GetStaticOrder() const {
+  return static_order_;
+}
+/**
+ * @brief Returns true if u is matched after the search (a DAG leaf, with
+ * postpone_leaves).
+ *
+ * @param u query vertex.
+ * @return bool
+ */
+inline bool MatchingOrder::IsPostponed(Vertex u) const {
+  return postponed_[u];
+}
+/**
+ * @brief Returns IsPostponed for every query vertex.
+ *
+ * @return const std::vector<char>&
+ */
+inline const std::vector<char> &MatchingOrder::GetPostponed() const {
+  return postponed_;
+}
+/**
+ * @brief Returns the path-size weight of candidate i of u. Only available
+ * for the path-size based strategies.
+ *
+ * @param u query vertex.
+ * @param i position of the candidate in C(u).
+ * @return double
+ */
+inline double MatchingOrder::GetWeight(Vertex u, uint32_t i) const {
+  return weights_[weight_offset_[u] + i];
+}
+
+#endif  // MATCHING_ORDER_H_
@@ -0,0 +1,165 @@
+/**
+ * @file multi_query_matcher.h
+ * @brief batches of query graphs matched together, sharing the search of
+ * their common sub-patterns.
+ *
+ */
+
+#ifndef MULTI_QUERY_MATCHER_H_
+#define MULTI_QUERY_MATCHER_H_
+
+#include "candidate_set.h"
+#include "common.h"
+#include "graph.h"
+#include "search_options.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Receives one embedding of the query with the given index:
+ * embedding[u] is the data vertex matched to query vertex u.
+ */
+using BatchCallback = std::function<void(
+    size_t query, const std::vector<Vertex> &embedding)>;
+
+/**
+ * @brief Matches many query graphs against one data graph in a single
+ * search, enumerating the embeddings of the sub-patterns they have in common
+ * once.
+ *
+ * Every query is a path from the root of a trie of pattern vertices. A
+ * pattern vertex has a label and the depths of the earlier pattern vertices
+ * it is adjacent to (its backward edges), so a path of length k is a
+ * connected pattern whose partial embeddings are enumerated once for all
+ * the queries through it, and the search branches where their paths split.
+ * When a query is added, it follows the existing pattern vertices as far as
+ * some unmatched query vertex has the label and shares a backward edge;
+ * backward edges the query does not have move to the queries that do, and
+ * the query's own are checked for it alone, so that sparse and dense
+ * variants of a motif share their whole path. The rest of the query becomes
+ * a new branch, ordered connected vertices first, leaves last, and
+ * otherwise by the fewest candidates adjacent to a candidate of a matched
+ * neighbor, on average.
+ *
+ * The search keeps, for every depth, which queries through the current
+ * pattern vertex are still alive, i.e. have all their matched vertices in
+ * their candidate sets and all their own edges; a branch is abandoned once
+ * none is. Embeddings are counted without symmetry breaking, like
+ * CountMatches, and in the vertex ids of the data graph file.
+ */
+class MultiQueryMatcher {
+ public:
+  MultiQueryMatcher(const Graph &data, const SearchOptions &options);
+  ~MultiQueryMatcher();
+
+  size_t AddQuery(const std::string &query_filename,
+                  const std::string &candidate_filename = "");
+  inline size_t GetNumQueries() const;
+  inline size_t GetNumPatternVertices() const;
+  inline size_t GetNumQueryVertices() const;
+
+  std::vector<size_t> CountMatches();
+  std::vector<size_t> FindMatches(const BatchCallback &callback);
+
+  bool IsInterrupted() const;
+
+ private:
+  /**
+   * @brief A query whose path goes through a pattern vertex.
+   */
+  struct Member {
+    size_t query;
+    // query vertex matched at this depth
+    Vertex u;
+    // depths of the matched query neighbors of u that are not backward edges
+    // of the pattern vertex
+    std::vector<uint32_t> extra;
+    // u is the last vertex of the query
+    bool last;
+  };
+
+  struct Node {
+    Label label;
+    std::vector<uint32_t> backward;
+    std::vector<Member> members;
+    std::vector<size_t> children;
+    // without backward edges, the union of the candidates of the members
+    std::vector<Vertex> roots;
+  };
+
+  struct Query {
+    std::unique_ptr<Graph> graph;
+    std::unique_ptr<CandidateSet> cs;
+    // query vertex matched at each depth
+    std::vector<Vertex> order;
+  };
+
+  /**
+   * @brief Search state of one thread.
+   */
+  struct State {
+    // data vertex matched at each depth
+    std::vector<Vertex> mapped;
+    std::vector<char> used;
+    // alive[depth * number of queries + q]
+    std::vector<char> alive;
+    std::vector<Vertex> embedding;
+    std::vector<size_t> num_matches;
+    size_t num_visits = 0;
+  };
+
+  void Insert(size_t query);
+  std::vector<size_t> Search(const BatchCallback *callback);
+  void Extend(State &state, size_t node, size_t depth);
+  void Visit(State &state, size_t node, size_t depth, Vertex v);
+  void Report(State &state, size_t query);
+  bool CheckStop();
+
+  const Graph &data_;
+  const SearchOptions options_;
+
+  std::vector<Query> queries_;
+  // nodes_[0] is the root, the empty pattern
+  std::vector<Node> nodes_;
+  size_t max_depth_;
+
+  const BatchCallback *callback_;
+  std::mutex callback_mutex_;
+  std::atomic<bool> stop_;
+  std::atomic<bool> interrupted_;
+  std::chrono::steady_clock::time_point deadline_;
+};
+
+/**
+ * @brief Returns the number of added queries.
+ *
+ * @return size_t
+ */
+inline size_t MultiQueryMatcher::GetNumQueries() const {
+  return queries_.size();
+}
+/**
+ * @brief Returns the number of pattern vertices the search matches, which is
+ * at most GetNumQueryVertices().
+ *
+ * @return size_t
+ */
+inline size_t MultiQueryMatcher::GetNumPatternVertices() const {
+  return nodes_.size() - 1;
+}
+/**
+ * @brief Returns the total number of vertices of the added queries.
+ *
+ * @return size_t
+ */
+inline size_t MultiQueryMatcher::GetNumQueryVertices() const {
+  size_t num_vertices = 0;
+  for (auto &query : queries_) num_vertices += query.graph->GetNumVertices();
+  return num_vertices;
+}
+
+#endif  // MULTI_QUERY_MATCHER_H_
@@ -0,0 +1,119 @@
+/**
+ * @file output_sink.h
+ * @brief buffered text and binary writers for embeddings.
+ *
+ */
+
+#ifndef OUTPUT_SINK_H_
+#define OUTPUT_SINK_H_
+
+#include "common.h"
+
+#include <cstdio>
+#include <mutex>
+
+/**
+ * @brief Text output is one line "a v_0 v_1 ... v_{n-1}" per embedding after
+ * a "t n" header line. Binary output is a 16-byte header (the magic
+ * "GPMEMB01", the number n of query vertices as uint32 and 4 reserved bytes)
+ * followed by one record of n native-endian int32 per embedding.
+ *
+ * Factorized output is text output where a group of embeddings that differ
+ * only on the postponed leaves of the query is written as one record: a line
+ * "f v_0 v_1 ... v_{n-1}" with -1 for the leaves, then one line
+ * "l u x_1 ... x_k" per leaf u listing its data vertices. The group holds
+ * every assignment of distinct listed data vertices to the leaves. Plain
+ * "a" lines may still appear, e.g. for a group cut by a limit.
+ */
+enum class OutputFormat { kText, kBinary, kFactorized };
+
+/**
+ * @brief Destination of the embeddings, shared by all workers. Writes of
+ * whole buffers are serialized, so records never interleave.
+ */
+class OutputSink {
+ public:
+  OutputSink(FILE *file, OutputFormat format, size_t num_query_vertices);
+  ~OutputSink();
+
+  void WriteHeader();
+  void Write(const char *data, size_t size);
+
+  inline OutputFormat GetFormat() const;
+  inline size_t GetNumQueryVertices() const;
+
+ private:
+  FILE *file_;
+  const OutputFormat format_;
+  const size_t num_query_vertices_;
+  std::mutex mutex_;
+};
+
+/**
+ * @brief Per-worker buffer of formatted embeddings. It is allocated once and
+ * handed to the sink whenever it is nearly full.
+ */
+class OutputBuffer {
+ public:
+  explicit OutputBuffer(OutputSink &sink);
+  ~OutputBuffer();
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  inline void Append(const Vertex *embedding);
+  void AppendFactorized(const Vertex *embedding,
+                        const std::vector<Vertex> &leaves,
+                        const Vertex *candidates, const size_t *offsets);
+  void Flush();
+
+ private:
+  void AppendText(const Vertex *embedding);
+  char *AppendVertex(Vertex v, char *out);
+
+  OutputSink &sink_;
+  const size_t num_query_vertices_;
+  const bool binary_;
+  // the largest record that can be appended
+  const size_t record_capacity_;
+
+  std::vector<char> buffer_;
+  size_t size_;
+};
+
+/**
+ * @brief Returns the format the sink writes.
+ *
+ * @return OutputFormat
+ */
+inline OutputFormat OutputSink::GetFormat() const { return format_; }
+/**
+ * @brief Returns the number of data vertices per embedding.
+ *
+ * @return size_t
+ */
+inline size_t OutputSink::GetNumQueryVertices() const {
+  return num_query_vertices_;
+}
+
+/**
+ * @brief Appends one embedding, embedding[u] being the data vertex of query
+ * vertex u.
+ *
+ * @param embedding
+ */
+inline void OutputBuffer::Append(const Vertex *embedding) {
+  if (size_ + record_capacity_ > buffer_.size()) Flush();
+
+  if (binary_) {
+    size_t bytes = num_query_vertices_ * sizeof(Vertex);
+    std::copy(reinterpret_cast<const char *>(embedding),
+              reinterpret_cast<const char *>(embedding) + bytes,
+              buffer_.data() + size_);
+    size_ += bytes;
+  } else {
+    AppendText(embedding);
+  }
+}
+
+#endif  // OUTPUT_SINK_H_
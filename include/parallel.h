@@ -0,0 +1,61 @@
+/**
+ * @file parallel.h
+ * @brief minimal helpers for splitting a loop over several threads.
+ *
+ */
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Returns the number of worker threads to use when the caller asked for
+ * `requested` threads (0 means one per hardware thread).
+ *
+ * @param requested
+ * @return size_t
+ */
+inline size_t GetNumThreads(size_t requested = 0) {
+  if (requested != 0) return requested;
+  size_t hw = std::thread::hardware_concurrency();
+  return hw == 0 ? 1 : hw;
+}
+
+/**
+ * @brief Splits [begin, end) into at most num_threads contiguous blocks and
+ * calls f(block_begin, block_end, thread_index) for each of them, one block
+ * per thread. The calling thread runs the first block itself.
+ *
+ * @param begin
+ * @param end
+ * @param num_threads
+ * @param f
+ */
+template <typename F>
+void ParallelFor(size_t begin, size_t end, size_t num_threads, F f) {
+  if (end <= begin) return;
+  size_t n = end - begin;
+  num_threads = std::max<size_t>(1, std::min(num_threads, n));
+
+  if (num_threads == 1) {
+    f(begin, end, 0);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t t = 1; t < num_threads; ++t) {
+    size_t b = begin + n * t / num_threads;
+    size_t e = begin + n * (t + 1) / num_threads;
+    threads.emplace_back([&f, b, e, t]() { f(b, e, t); });
+  }
+  f(begin, begin + n / num_threads, 0);
+
+  for (auto &thread : threads) thread.join();
+}
+
+#endif  // PARALLEL_H_
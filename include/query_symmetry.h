@@ -0,0 +1,161 @@
+/**
+ * @file query_symmetry.h
+ * @brief automorphisms of a query graph and the constraints that break them.
+ *
+ */
+
+#ifndef QUERY_SYMMETRY_H_
+#define QUERY_SYMMETRY_H_
+
+#include "common.h"
+#include "graph.h"
+
+#include <cstdint>
+
+/**
+ * @brief Automorphism group of a query graph, as a stabilizer chain, and the
+ * symmetry-breaking constraints of Grochow and Kellis [3].
+ *
+ * At step k the smallest vertex v_k with a nontrivial orbit under the
+ * automorphisms that fix v_1, ..., v_{k-1} is chosen, and for every other
+ * vertex w of that orbit the constraint M(v_k) < M(w) is added, M being the
+ * embedding. Every class of embeddings equal up to a query automorphism then
+ * holds exactly one embedding that satisfies all constraints, the canonical
+ * one. The class is recovered by composing the canonical embedding with the
+ * products t_1 t_2 ... t_k, t_k ranging over one automorphism per vertex of
+ * orbit k (the transversal), which enumerates the group once.
+ *
+ * Automorphisms are found by backtracking over the query vertices, restricted
+ * to vertices of equal color after color refinement. If the searches exceed
+ * their budget, the chain is cut there; the constraints of the complete steps
+ * alone are still exact, only less symmetry is broken.
+ *
+ * Vertices may be required to stay fixed, e.g. the postponed leaves of a
+ * factorized search, which the constraints then never mention. The group is
+ * then the subgroup of the automorphisms that fix them.
+ */
+class QuerySymmetry {
+ public:
+  explicit QuerySymmetry(const Graph &query,
+                         const std::vector<char> &fixed_vertices = {});
+  ~QuerySymmetry();
+
+  inline bool IsTrivial() const;
+  inline size_t GetGroupSize() const;
+  inline size_t GetNumSteps() const;
+
+  inline bool IsAllowed(Vertex u, Vertex v, const Vertex *embedding,
+                        Vertex *conflict) const;
+
+  template <typename F>
+  bool Expand(const Vertex *embedding, Vertex *scratch, F &&emit) const;
+
+ private:
+  std::vector<uint32_t> RefineColors(const std::vector<Vertex> &fixed) const;
+  bool FindAutomorphism(const std::vector<Vertex> &fixed, Vertex v, Vertex w,
+                        const std::vector<uint32_t> &colors,
+                        std::vector<Vertex> *automorphism,
+                        size_t *budget) const;
+
+  template <typename F>
+  bool Expand(size_t step, const Vertex *embedding, Vertex *scratch,
+              F &emit) const;
+
+  const Graph &query_;
+  const size_t num_vertices_;
+  size_t group_size_;
+
+  // automorphisms of each step, as images of the query vertices:
+  // transversal_[transversal_offset_[k] + t * num_vertices_ + u]
+  std::vector<size_t> transversal_offset_;
+  std::vector<Vertex> transversal_;
+
+  // constraints of u: bounds_[bound_offset_[u]] .. bounds_[bound_offset_[u+1]]
+  // hold the query vertices w with M(u) < M(w) (encoded as w) or
+  // M(w) < M(u) (encoded as ~w)
+  std::vector<size_t> bound_offset_;
+  std::vector<Vertex> bounds_;
+};
+
+/**
+ * @brief Returns true if the query has no automorphism besides the identity
+ * (or none was found).
+ *
+ * @return bool
+ */
+inline bool QuerySymmetry::IsTrivial() const { return group_size_ == 1; }
+
+/**
+ * @brief Returns the number of automorphisms, i.e. the number of embeddings
+ * represented by one canonical embedding.
+ *
+ * @return size_t
+ */
+inline size_t QuerySymmetry::GetGroupSize() const { return group_size_; }
+
+/**
+ * @brief Returns the length of the stabilizer chain.
+ *
+ * @return size_t
+ */
+inline size_t QuerySymmetry::GetNumSteps() const {
+  return transversal_offset_.size() - 1;
+}
+
+/**
+ * @brief Checks the constraints between u and the matched query vertices.
+ *
+ * @param u query vertex being matched.
+ * @param v its data vertex.
+ * @param embedding data vertex of each query vertex, -1 if unmatched.
+ * @param conflict set to the matched vertex of a violated constraint.
+ * @return false if matching u to v violates a constraint.
+ */
+inline bool QuerySymmetry::IsAllowed(Vertex u, Vertex v,
+                                     const Vertex *embedding,
+                                     Vertex *conflict) const {
+  for (size_t i = bound_offset_[u]; i < bound_offset_[u + 1]; ++i) {
+    Vertex w = bounds_[i] >= 0 ? bounds_[i] : ~bounds_[i];
+    Vertex x = embedding[w];
+    if (x < 0) continue;
+    if (bounds_[i] >= 0 ? x < v : x > v) {
+      *conflict = w;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Calls emit on every embedding equal to the canonical one up to a
+ * query automorphism, the canonical one first.
+ *
+ * @param embedding canonical embedding.
+ * @param scratch (GetNumSteps() + 1) * number of query vertices entries.
+ * @param emit bool(const Vertex *embedding), returns false to stop.
+ * @return false if emit stopped the expansion.
+ */
+template <typename F>
+bool QuerySymmetry::Expand(const Vertex *embedding, Vertex *scratch,
+                           F &&emit) const {
+  return Expand(0, embedding, scratch, emit);
+}
+
+template <typename F>
+bool QuerySymmetry::Expand(size_t step, const Vertex *embedding,
+                           Vertex *scratch, F &emit) const {
+  if (step == GetNumSteps()) return emit(embedding);
+
+  for (size_t t = transversal_offset_[step]; t < transversal_offset_[step + 1];
+       t += num_vertices_) {
+    // embedding o automorphism
+    const Vertex *automorphism = &transversal_[t];
+    for (size_t u = 0; u < num_vertices_; ++u)
+      scratch[u] = embedding[automorphism[u]];
+    if (!Expand(step + 1, scratch, scratch + num_vertices_, emit))
+      return false;
+  }
+  return true;
+}
+
+#endif  // QUERY_SYMMETRY_H_
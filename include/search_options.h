@@ -0,0 +1,109 @@
+/**
+ * @file search_options.h
+ * @brief knobs of the backtracking search.
+ *
+ */
+
+#ifndef SEARCH_OPTIONS_H_
+#define SEARCH_OPTIONS_H_
+
+#include "cancellation.h"
+#include "common.h"
+#include "graph.h"
+#include "output_sink.h"
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Receives one embedding: embedding[u] is the data vertex matched to
+ * query vertex u. Returning false stops the search.
+ */
+using MatchCallback = std::function<bool(const std::vector<Vertex> &embedding)>;
+
+/**
+ * @brief Snapshot of a running search. covered is the estimated fraction of
+ * the search tree that has been explored, measured from the root: each root
+ * candidate counts 1 / |C(root)|, split evenly among its children, and so
+ * on down the tree.
+ */
+struct SearchProgress {
+  size_t num_matches;
+  double covered;
+  double elapsed_seconds;
+};
+
+/**
+ * @brief Receives periodic progress reports. It is called from a monitor
+ * thread, never concurrently with itself.
+ */
+using ProgressCallback = std::function<void(const SearchProgress &progress)>;
+
+/**
+ * @brief How the next query vertex is chosen among the extendable ones.
+ * kCandidateSize: fewest extendable candidates (adaptive).
+ * kPathSize: smallest sum of DAF path-size weights of the extendable
+ * candidates (adaptive).
+ * kStatic: a fixed RI-style order computed on the query alone.
+ * kHybrid: vertices with at most one extendable candidate first, then the
+ * path size, with DAG leaves postponed and ties broken by the static order.
+ */
+enum class OrderStrategy { kCandidateSize, kPathSize, kStatic, kHybrid };
+
+/**
+ * @brief Parses "candidate-size", "path-size", "static" or "hybrid".
+ *
+ * @param name
+ * @param strategy set on success.
+ * @return bool false if the name is unknown.
+ */
+inline bool ParseOrderStrategy(const std::string &name,
+                               OrderStrategy &strategy) {
+  if (name == "candidate-size")
+    strategy = OrderStrategy::kCandidateSize;
+  else if (name == "path-size")
+    strategy = OrderStrategy::kPathSize;
+  else if (name == "static")
+    strategy = OrderStrategy::kStatic;
+  else if (name == "hybrid")
+    strategy = OrderStrategy::kHybrid;
+  else
+    return false;
+  return true;
+}
+
+struct SearchOptions {
+  // number of search threads, 0 for one per hardware thread
+  size_t num_threads = 1;
+  // skip sibling candidates that are known to fail the same way (DAF)
+  bool failing_sets = false;
+  // search only embeddings that are canonical up to a query automorphism,
+  // and derive the others from them; off by default, so that embeddings are
+  // printed in the order the search finds them
+  bool symmetry_breaking = false;
+  // leave the DAG leaves out of the search and count or enumerate their
+  // assignments once the other query vertices are matched (implied by
+  // OutputFormat::kFactorized)
+  bool factorize = false;
+  // stop after this many embeddings, 0 for no limit
+  size_t limit = 0;
+  // format of the embeddings written by PrintAllMatches
+  OutputFormat output_format = OutputFormat::kText;
+  // matching order
+  OrderStrategy order = OrderStrategy::kCandidateSize;
+  // key by which the query DAG is built
+  DAGFrontier dag_frontier = DAGFrontier::kLegacy;
+  // where to write per-level search statistics as JSON (only in builds with
+  // SEARCH_STATS), empty for none
+  std::string stats_file;
+  // stop the search after this many seconds, 0 for no time limit
+  double time_limit = 0;
+  // stop the search once this token is cancelled (not owned)
+  const CancellationToken *cancellation = nullptr;
+  // called every progress_interval seconds during the search, and once at
+  // the end
+  ProgressCallback progress;
+  double progress_interval = 1;
+};
+
+#endif  // SEARCH_OPTIONS_H_
@@ -0,0 +1,69 @@
+/**
+ * @file search_stats.h
+ * @brief per-level counters of the search tree, compiled in only when
+ * SEARCH_STATS is defined (cmake -DSEARCH_STATS=ON).
+ *
+ */
+
+#ifndef SEARCH_STATS_H_
+#define SEARCH_STATS_H_
+
+#include "common.h"
+
+#include <cstdint>
+
+/**
+ * @brief Counters of one level of the search tree. Level l matches the l-th
+ * query vertex of the matching order.
+ *
+ * nodes: candidates matched at the level.
+ * visited_rejections: candidates skipped because their data vertex was
+ * already matched (found when tried with failing sets, when the candidates
+ * of a child are computed otherwise).
+ * adjacency_rejections: candidates of a child that are not adjacent to the
+ * data vertices of all its parents.
+ * symmetry_rejections: candidates that violate a symmetry-breaking
+ * constraint.
+ * dead_ends: matches undone because a child was left without candidates.
+ * adjacency_probes: candidate-space entries read to compute the candidates
+ * of the children, the counterpart of the IsNeighbor calls of a search
+ * without the candidate-space index.
+ */
+struct LevelStats {
+  uint64_t nodes = 0;
+  uint64_t visited_rejections = 0;
+  uint64_t adjacency_rejections = 0;
+  uint64_t symmetry_rejections = 0;
+  uint64_t dead_ends = 0;
+  uint64_t adjacency_probes = 0;
+
+  void Add(const LevelStats &other);
+};
+
+/**
+ * @brief Counters of every level, merged over the workers of a search.
+ */
+class SearchStats {
+ public:
+  explicit SearchStats(size_t num_levels = 0);
+  ~SearchStats();
+
+  inline LevelStats &operator[](size_t level);
+  void Add(const SearchStats &other);
+  void WriteJSON(std::ostream &out) const;
+
+ private:
+  std::vector<LevelStats> levels_;
+};
+
+/**
+ * @brief Returns the counters of the level.
+ *
+ * @param level in [1, number of query vertices].
+ * @return LevelStats&
+ */
+inline LevelStats &SearchStats::operator[](size_t level) {
+  return levels_[level];
+}
+
+#endif  // SEARCH_STATS_H_
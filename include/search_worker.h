@@ -0,0 +1,276 @@
+/**
+ * @file search_worker.h
+ * @brief backtracking search state of one thread.
+ *
+ */
+
+#ifndef SEARCH_WORKER_H_
+#define SEARCH_WORKER_H_
+
+#include "candidate_set.h"
+#include "candidate_space.h"
+#include "common.h"
+#include "graph.h"
+#include "matching_order.h"
+#include "output_sink.h"
+#include "query_symmetry.h"
+#include "search_options.h"
+#include "search_stats.h"
+#include "task_pool.h"
+
+#include <atomic>
+#include <mutex>
+
+/**
+ * @brief What a worker does with the embeddings it finds.
+ */
+enum class MatchMode { kPrint, kCount, kCallback };
+
+/**
+ * @brief State shared by all workers of one search.
+ */
+struct SearchContext {
+  SearchContext(size_t num_workers, const SearchOptions &options,
+                MatchMode mode, const MatchCallback *callback,
+                OutputSink *sink)
+      : pool(num_workers),
+        options(options),
+        mode(mode),
+        callback(callback),
+        sink(sink),
+        num_matches(0),
+        stop(false) {}
+
+  TaskPool pool;
+  const SearchOptions options;
+  const MatchMode mode;
+  const MatchCallback *callback;
+  // destination of the embeddings in MatchMode::kPrint
+  OutputSink *sink;
+
+  // serializes calls of the callback
+  std::mutex callback_mutex;
+  // embeddings found so far (updated per embedding only if there is a limit)
+  std::atomic<size_t> num_matches;
+  // set when the limit is reached or the callback asks to stop
+  std::atomic<bool> stop;
+
+#ifdef SEARCH_STATS
+  // counters of all workers, merged when they finish
+  std::mutex stats_mutex;
+  SearchStats stats;
+#endif
+};
+
+/**
+ * @brief Explores the search tree of the tasks it takes from a TaskPool.
+ *
+ * All search state lives in flat arrays allocated once in the constructor:
+ * the mapping of query vertices, a stamped visited array over the data
+ * vertices, and one buffer per query vertex holding its extendable
+ * candidates. A search step therefore allocates nothing. Candidates are
+ * handled by their position in the candidate set, and the extendable
+ * candidates of a query vertex are the intersection of the CandidateSpace
+ * lists of its matched parents. Embeddings are
+ * collected in a private OutputBuffer that is written to the sink as a whole,
+ * so records of different workers never interleave.
+ *
+ * With failing sets enabled, every level also accumulates the failing set of
+ * its subtree as a bitset over the query vertices [1]. Once a child subtree
+ * fails for a reason that does not involve the query vertex of the level,
+ * the remaining candidates of the level are skipped.
+ *
+ * With a QuerySymmetry, candidates that violate its constraints are skipped
+ * (a conflict with the other vertex of the constraint, for failing sets),
+ * and every embedding found stands for GetGroupSize() embeddings.
+ *
+ * Query vertices postponed by the MatchingOrder get no level. Once all other
+ * vertices are matched, the unvisited candidates of each leaf are collected
+ * and the injective assignments of leaves to them are counted, enumerated,
+ * or written as one factorized record. Leaves of different labels cannot
+ * share a data vertex, so they are counted per label and multiplied.
+ */
+class SearchWorker {
+ public:
+  SearchWorker(const Graph &data, const Graph &dag, const CandidateSet &cs,
+               const CandidateSpace &space, const MatchingOrder &order,
+               const QuerySymmetry *symmetry, SearchContext &context,
+               size_t id);
+  ~SearchWorker();
+
+  void Run();
+
+  inline size_t GetNumMatches() const;
+  inline double GetCovered() const;
+
+ private:
+  void RunTask(const SearchTask &task);
+  bool Match(Vertex u, uint32_t i, size_t level);
+  void Unmatch(Vertex u);
+  bool ComputeCandidates(Vertex u, size_t level);
+  Vertex SelectNext() const;
+  void SetCandidates(Vertex u, const uint32_t *begin, const uint32_t *end);
+  void Donate(size_t level);
+  bool Emit();
+  bool ReportAll(size_t &remaining);
+  bool Report(const Vertex *embedding);
+  const Vertex *ToOriginalIDs(const Vertex *embedding);
+  size_t CountLeafAssignments();
+  size_t CountInjective(size_t i, size_t end);
+  bool ExpandLeaves(size_t i, size_t &remaining);
+  void PublishProgress(size_t level);
+
+  void ClearFailingSet(size_t level);
+  void AddFailingSet(size_t level, const uint64_t *fs);
+  void AddConflict(size_t level, Vertex u1, Vertex u2);
+
+  inline bool IsVisited(Vertex v) const;
+  inline uint64_t *GetFailingSet(size_t level);
+  inline const uint64_t *GetAncestors(Vertex u) const;
+
+  const Graph &data_;
+  const Graph &dag_;
+  const CandidateSet &cs_;
+  const CandidateSpace &space_;
+  const MatchingOrder &matching_order_;
+  // nullptr if no symmetry is broken
+  const QuerySymmetry *symmetry_;
+  SearchContext &context_;
+  const SearchOptions &options_;
+  TaskPool &pool_;
+  const size_t id_;
+  const size_t num_query_vertices_;
+  // query vertices postponed by the matching order, grouped by label, and
+  // the number of levels of the search (the other vertices)
+  std::vector<Vertex> leaves_;
+  std::vector<size_t> leaf_group_offset_;
+  size_t num_levels_;
+
+  // embeddings found by this worker (without a limit)
+  size_t num_matches_;
+
+  // num_matches_ and the share of the search tree covered by this worker,
+  // published for progress reports
+  std::atomic<size_t> published_matches_;
+  std::atomic<double> covered_;
+  // share of finished tasks and of the finished parts of the current one
+  double completed_;
+  // share of the search tree below each candidate of each level
+  std::vector<double> unit_;
+  // candidates donated at each level, not covered by this worker
+  std::vector<size_t> donated_;
+  // candidates of the first level of the current task that were not donated
+  size_t top_end_;
+  // search steps left before the next PublishProgress
+  uint32_t publish_countdown_;
+
+  // number of levels whose data vertex is fixed by the current task
+  size_t forced_;
+
+  // data vertex matched to each query vertex, -1 if unmatched, and its
+  // position in the candidate set of the query vertex
+  std::vector<Vertex> embedding_;
+  std::vector<uint32_t> position_;
+  // data vertex v is matched iff visited_[v] == epoch_
+  std::vector<uint32_t> visited_;
+  uint32_t epoch_;
+
+  // number of DAG parents of each query vertex, and how many are matched
+  std::vector<size_t> num_parents_;
+  std::vector<size_t> num_matched_parents_;
+
+  // positions of the extendable candidates of u:
+  // candidates_[candidate_offset_[u] + i] for i < num_candidates_[u]; the
+  // capacity of each buffer is |C(u)| + kIntersectPadding
+  std::vector<size_t> candidate_offset_;
+  std::vector<size_t> num_candidates_;
+  std::vector<uint32_t> candidates_;
+  // intermediate results of multi-parent intersections
+  std::vector<uint32_t> scratch_;
+
+  // query vertex matched at each level, the index of its candidate being
+  // tried, and the end of its candidate range (lowered when work is donated)
+  std::vector<Vertex> order_;
+  std::vector<size_t> cursor_;
+  std::vector<size_t> end_;
+
+  // query vertex matched to each data vertex (valid while it is visited)
+  std::vector<Vertex> owner_;
+  // child whose candidates became empty in the last failed Match
+  Vertex failed_child_;
+
+  // bitsets of fs_words_ words: ancestors of each query vertex in the DAG
+  // (itself included), and the failing set accumulated at each level
+  size_t fs_words_;
+  std::vector<uint64_t> ancestors_;
+  std::vector<uint64_t> failing_sets_;
+  std::vector<uint64_t> conflict_;
+  // whether an embedding was found below each level
+  std::vector<char> found_;
+
+  std::unique_ptr<OutputBuffer> output_;
+  // unvisited data vertices of leaves_[i] once all levels are matched:
+  // leaf_candidates_[leaf_offset_[i]] .. leaf_candidates_[leaf_offset_[i+1]]
+  std::vector<size_t> leaf_offset_;
+  std::vector<Vertex> leaf_candidates_;
+
+  // scratch of QuerySymmetry::Expand, and the copy of an expanded or
+  // translated embedding passed to the callback or the output
+  std::vector<Vertex> expanded_;
+  std::vector<Vertex> match_;
+
+#ifdef SEARCH_STATS
+  SearchStats stats_;
+#endif
+};
+
+/**
+ * @brief Returns the number of embeddings found so far (without a limit).
+ * Safe to call from another thread.
+ *
+ * @return size_t
+ */
+inline size_t SearchWorker::GetNumMatches() const {
+  return published_matches_.load(std::memory_order_relaxed);
+}
+/**
+ * @brief Returns the share of the search tree explored by this worker so
+ * far. Safe to call from another thread.
+ *
+ * @return double
+ */
+inline double SearchWorker::GetCovered() const {
+  return covered_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns true if the data vertex v is matched to some query vertex.
+ *
+ * @param v data vertex id.
+ * @return bool
+ */
+inline bool SearchWorker::IsVisited(Vertex v) const {
+  return visited_[v] == epoch_;
+}
+
+/**
+ * @brief Returns the failing set accumulated at the level.
+ *
+ * @param level
+ * @return uint64_t*
+ */
+inline uint64_t *SearchWorker::GetFailingSet(size_t level) {
+  return &failing_sets_[level * fs_words_];
+}
+
+/**
+ * @brief Returns the bitset of the DAG ancestors of u, u included.
+ *
+ * @param u query vertex.
+ * @return const uint64_t*
+ */
+inline const uint64_t *SearchWorker::GetAncestors(Vertex u) const {
+  return &ancestors_[u * fs_words_];
+}
+
+#endif  // SEARCH_WORKER_H_
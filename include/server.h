@@ -0,0 +1,72 @@
+/**
+ * @file server.h
+ * @brief long-running matcher that keeps data graphs resident between
+ * queries.
+ *
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "common.h"
+#include "graph.h"
+#include "search_options.h"
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Answers line-based requests, one per line:
+ *
+ *   load <data graph file>
+ *   unload <data graph file>
+ *   match <data graph file> <query graph file> [<candidate set file>]
+ *         [--limit <k>] [--count] [--threads <n>] [--failing-sets]
+ *         [--[no-]symmetry] [--factorize] [--refine] [--order <strategy>]
+ *         [--dag-frontier <key>] [--time-limit <seconds>]
+ *         [--estimate <samples>]
+ *   quit
+ *
+ * Data graphs are identified by their path and loaded at their first use.
+ * A match request streams the "t n" header and one "a ..." line per
+ * embedding; --count only reports the number. Every request ends with
+ * "ok [<number>]" or "error <message>"; a match stopped by its time limit
+ * ends with "ok <number> interrupted". --estimate only samples the number,
+ * ending with "ok <estimate> <low> <high>", followed by " unreliable" when
+ * too few walks reached an embedding (see Backtrack::EstimateMatches).
+ * A file that cannot be read or parsed, or a candidate set that does not
+ * fit the query, only fails its request with "error <message>".
+ * Options given to the server are the defaults of every match request. Data
+ * graphs may be reordered when they are loaded; candidate set files and
+ * embeddings still use the ids of the input file.
+ */
+class Server {
+ public:
+  explicit Server(const SearchOptions &options,
+                  VertexOrdering ordering = VertexOrdering::kNone);
+  ~Server();
+
+  bool Load(const std::string &filename, std::string &error);
+
+  void Serve(FILE *in, FILE *out);
+  void Listen(const std::string &socket_path);
+
+ private:
+  std::shared_ptr<const Graph> GetGraph(const std::string &filename,
+                                        std::string &error);
+  bool HandleRequest(const std::vector<std::string> &args, FILE *out);
+  void Match(const std::vector<std::string> &args, FILE *out);
+
+  const SearchOptions options_;
+  // applied to every data graph when it is loaded
+  const VertexOrdering ordering_;
+
+  // resident data graphs by path; a request keeps its graph alive even if it
+  // is unloaded meanwhile
+  std::mutex graphs_mutex_;
+  std::map<std::string, std::shared_ptr<const Graph>> graphs_;
+};
+
+#endif  // SERVER_H_
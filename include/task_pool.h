@@ -0,0 +1,83 @@
+/**
+ * @file task_pool.h
+ * @brief per-worker task deques with stealing, used by the parallel search.
+ *
+ */
+
+#ifndef TASK_POOL_H_
+#define TASK_POOL_H_
+
+#include "common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief A subtree of the search: the candidates matched at the first levels
+ * (replayed one per level) and the candidates that are left to try at the
+ * level right after them. Candidates are given by their position in the
+ * candidate set of the query vertex of their level. weight is the share of
+ * the whole search tree below each of the candidates, for progress reports.
+ */
+struct SearchTask {
+  std::vector<uint32_t> prefix;
+  std::vector<uint32_t> candidates;
+  double weight = 0;
+};
+
+class TaskPool {
+ public:
+  explicit TaskPool(size_t num_workers);
+  ~TaskPool();
+
+  void Push(size_t worker, SearchTask &&task);
+  bool Pop(size_t worker, SearchTask &task);
+  void Done();
+
+  inline bool IsHungry() const;
+  inline bool IsEmpty(size_t worker) const;
+
+ private:
+  struct Deque {
+    std::mutex mutex;
+    std::deque<SearchTask> tasks;
+    std::atomic<size_t> size;
+  };
+
+  bool TryPop(size_t worker, SearchTask &task);
+
+  std::vector<std::unique_ptr<Deque>> deques_;
+
+  // tasks that are queued or running; the search is over when it drops to 0
+  std::atomic<size_t> pending_;
+  // workers that found nothing to run or steal
+  std::atomic<size_t> hungry_;
+
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cv_;
+};
+
+/**
+ * @brief Returns true if some worker is idle and waiting for work. Busy
+ * workers poll this to decide when to split their search.
+ *
+ * @return bool
+ */
+inline bool TaskPool::IsHungry() const {
+  return hungry_.load(std::memory_order_relaxed) > 0;
+}
+
+/**
+ * @brief Returns true if the deque of the worker has no queued task.
+ *
+ * @param worker worker index.
+ * @return bool
+ */
+inline bool TaskPool::IsEmpty(size_t worker) const {
+  return deques_[worker]->size.load(std::memory_order_relaxed) == 0;
+}
+
+#endif  // TASK_POOL_H_
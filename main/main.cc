@@ -6,26 +6,447 @@
 #include "backtrack.h"
 #include "candidate_set.h"
 #include "common.h"
+#include "continuous_matcher.h"
 #include "graph.h"
+#include "multi_query_matcher.h"
+#include "query_symmetry.h"
+#include "server.h"
 
-int main(int argc, char* argv[]) {
-  if (argc < 4) {
-    std::cerr << "Usage: ./program <data graph file> <query graph file> "
-                 "<candidate set file>\n";
+#include <csignal>
+#include <cstdio>
+#include <memory>
+
+namespace {
+// cancelled by SIGINT and SIGTERM, so that the embeddings found so far are
+// flushed before the program exits
+CancellationToken interrupt;
+
+void Interrupt(int) { interrupt.Cancel(); }
+
+void PrintUsage() {
+  std::cerr << "Usage: ./program [options] <data graph file> "
+               "<query graph file> [<candidate set file>]\n"
+               "       ./program [options] --serve [<data graph file>...]\n"
+               "       ./program [options] --socket <path> "
+               "[<data graph file>...]\n"
+               "       ./program [options] --updates <update file> "
+               "<data graph file>\n"
+               "                 <query graph file>...\n"
+               "       ./program [options] --batch <data graph file> "
+               "<query graph file>...\n"
+               "Options:\n"
+               "  --save-snapshot <file>  write a binary snapshot of the data "
+               "graph\n"
+               "                          (the data graph file may itself be "
+               "a snapshot)\n"
+               "  --save-candidates <file>\n"
+               "                          write the candidate set in the binary "
+               "format\n"
+               "                          (.csb), which is mapped instead of "
+               "parsed\n"
+               "  --refine                remove candidates until the candidate "
+               "set is arc\n"
+               "                          consistent with the query, and "
+               "report it to stderr\n"
+               "  --reorder <ordering>    renumber the data graph vertices for "
+               "locality:\n"
+               "                          none (default), label-degree, bfs "
+               "or rcm\n"
+               "  --threads <n>           number of search threads (0: one "
+               "per core,\n"
+               "                          default: 1)\n"
+               "  --failing-sets          prune the search with DAF failing "
+               "sets\n"
+               "  --symmetry              search one embedding per class of "
+               "query\n"
+               "                          automorphisms and expand it "
+               "(--no-symmetry:\n"
+               "                          search every embedding, the "
+               "default)\n"
+               "  --count                 print only the number of embeddings\n"
+               "  --estimate <samples>    print an estimate of the number of "
+               "embeddings\n"
+               "                          and its 95% confidence interval, "
+               "from random\n"
+               "                          walks, instead of searching\n"
+               "  --limit <k>             stop after the first k embeddings\n"
+               "  --binary                write embeddings as fixed-width "
+               "binary records\n"
+               "  --factorize             match the leaves of the query DAG "
+               "after the\n"
+               "                          search, by counting or enumerating "
+               "them\n"
+               "  --factorized            the same, writing one record per "
+               "assignment of\n"
+               "                          the other vertices with the "
+               "candidates of each leaf\n"
+               "  --order <strategy>      matching order: candidate-size "
+               "(default),\n"
+               "                          path-size, static or hybrid\n"
+               "  --dag-frontier <key>    key of the next vertex of the query "
+               "DAG:\n"
+               "                          legacy (default) or unvisited\n"
+               "  --time-limit <seconds>  stop the search after this time, "
+               "keeping what\n"
+               "                          was found\n"
+               "  --progress              report progress to stderr every "
+               "second\n"
+               "  --dag-info              print the root and the layers of the "
+               "query DAG,\n"
+               "                          and the number of query "
+               "automorphisms, to stderr\n"
+               "  --stats <file>          write per-level search statistics as "
+               "JSON\n"
+               "                          (builds with -DSEARCH_STATS=ON)\n"
+               "  --serve                 answer requests on stdin, keeping "
+               "data graphs\n"
+               "                          loaded (see include/server.h)\n"
+               "  --socket <path>         the same on a Unix socket\n"
+               "  --updates <file>        apply the batches of updates of the "
+               "file (- for\n"
+               "                          stdin) and print the embeddings "
+               "each creates (+)\n"
+               "                          or destroys (-), see "
+               "include/continuous_matcher.h\n"
+               "  --batch                 match all the query graphs in one "
+               "search that\n"
+               "                          shares their common sub-patterns, "
+               "printing\n"
+               "                          \"a <query> <data vertices>\" per "
+               "embedding, then\n"
+               "                          \"n <query> <number>\" per query\n"
+               "Without a candidate set file, candidates are computed "
+               "in-process.\n";
+}
+
+/**
+ * @brief Applies the batches of updates read from in, separated by empty
+ * lines, and prints for each "t <batch>" followed by a "+ <query> <data
+ * vertices>" or "- <query> <data vertices>" line per embedding created or
+ * destroyed, or with count_only a "n <query> <created> <destroyed>" line per
+ * query.
+ */
+void RunUpdates(ContinuousMatcher &matcher, std::istream &in,
+                bool count_only) {
+  std::vector<GraphUpdate> batch;
+  std::vector<size_t> created(matcher.GetNumQueries());
+  std::vector<size_t> destroyed(matcher.GetNumQueries());
+  size_t batch_id = 0;
+
+  auto report = [&](size_t query, bool is_created,
+                    const std::vector<Vertex> &embedding) {
+    if (count_only) {
+      ++(is_created ? created : destroyed)[query];
+      return;
+    }
+    printf("%c %zu", is_created ? '+' : '-', query);
+    for (Vertex v : embedding) printf(" %d", v);
+    printf("\n");
+  };
+
+  auto flush = [&]() {
+    printf("t %zu\n", batch_id);
+    size_t num_applied = matcher.ApplyBatch(batch, report);
+    if (count_only) {
+      for (size_t q = 0; q < matcher.GetNumQueries(); ++q) {
+        printf("n %zu %zu %zu\n", q, created[q], destroyed[q]);
+        created[q] = destroyed[q] = 0;
+      }
+    }
+    if (num_applied != batch.size())
+      std::cerr << "batch " << batch_id << ": " << batch.size() - num_applied
+                << " of " << batch.size() << " updates did not apply\n";
+    fflush(stdout);
+    batch.clear();
+    ++batch_id;
+  };
+
+  std::string line;
+  while (std::getline(in, line)) {
+    GraphUpdate update;
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      if (!batch.empty()) flush();
+    } else if (ParseGraphUpdate(line, update)) {
+      batch.push_back(update);
+    } else {
+      std::cerr << "invalid update: " << line << "\n";
+    }
+  }
+  if (!batch.empty()) flush();
+}
+
+/**
+ * @brief Writes the root and the layers of the DAG of the query, and the
+ * number of its automorphisms, to stderr.
+ */
+void PrintDAGInfo(const Graph &query, const CandidateSet &cs,
+                  DAGFrontier frontier) {
+  std::unique_ptr<Graph> dag(query.BuildDAG(cs, frontier));
+  Vertex root = dag->GetRoot();
+  std::cerr << "root " << root << " (|C| = " << cs.GetCandidateSize(root)
+            << ", degree " << query.GetDegree(root) << ")\n";
+
+  std::vector<std::vector<Vertex>> layers(dag->GetNumLayers());
+  for (size_t u = 0; u < dag->GetNumVertices(); ++u)
+    layers[dag->GetLayer(u)].push_back(u);
+  for (size_t l = 0; l < layers.size(); ++l) {
+    std::cerr << "layer " << l << ":";
+    for (Vertex u : layers[l]) std::cerr << " " << u;
+    std::cerr << "\n";
+  }
+  std::cerr << "automorphisms " << QuerySymmetry(query).GetGroupSize() << "\n";
+}
+
+/**
+ * @brief Runs the program with the given arguments; main reports the errors
+ * it throws.
+ */
+int Run(int argc, char* argv[]) {
+  std::vector<std::string> args;
+  std::string snapshot_file_name;
+  std::string candidates_file_name;
+  std::string socket_path;
+  std::string updates_file_name;
+  SearchOptions options;
+  VertexOrdering ordering = VertexOrdering::kNone;
+  bool count_only = false;
+  size_t num_samples = 0;
+  bool serve = false;
+  bool dag_info = false;
+  bool refine = false;
+  bool batch = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--save-snapshot" && i + 1 < argc) {
+      snapshot_file_name = argv[++i];
+    } else if (arg == "--save-candidates" && i + 1 < argc) {
+      candidates_file_name = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc) {
+      options.num_threads = std::stoul(argv[++i]);
+    } else if (arg == "--failing-sets") {
+      options.failing_sets = true;
+    } else if (arg == "--symmetry") {
+      options.symmetry_breaking = true;
+    } else if (arg == "--no-symmetry") {
+      options.symmetry_breaking = false;
+    } else if (arg == "--count") {
+      count_only = true;
+    } else if (arg == "--estimate" && i + 1 < argc) {
+      num_samples = std::stoul(argv[++i]);
+    } else if (arg == "--binary") {
+      options.output_format = OutputFormat::kBinary;
+    } else if (arg == "--factorize") {
+      options.factorize = true;
+    } else if (arg == "--factorized") {
+      options.output_format = OutputFormat::kFactorized;
+      options.factorize = true;
+    } else if (arg == "--limit" && i + 1 < argc) {
+      options.limit = std::stoul(argv[++i]);
+    } else if (arg == "--order" && i + 1 < argc) {
+      if (!ParseOrderStrategy(argv[++i], options.order)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--dag-frontier" && i + 1 < argc) {
+      if (!ParseDAGFrontier(argv[++i], options.dag_frontier)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--reorder" && i + 1 < argc) {
+      if (!ParseVertexOrdering(argv[++i], ordering)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--stats" && i + 1 < argc) {
+      options.stats_file = argv[++i];
+#ifndef SEARCH_STATS
+      std::cerr << "--stats needs a build configured with -DSEARCH_STATS=ON\n";
+#endif
+    } else if (arg == "--time-limit" && i + 1 < argc) {
+      options.time_limit = std::stod(argv[++i]);
+    } else if (arg == "--progress") {
+      options.progress = [](const SearchProgress &progress) {
+        fprintf(stderr, "%.1fs: %zu embeddings, %.2f%% of the search tree\n",
+                progress.elapsed_seconds, progress.num_matches,
+                progress.covered * 100);
+      };
+    } else if (arg == "--refine") {
+      refine = true;
+    } else if (arg == "--dag-info") {
+      dag_info = true;
+    } else if (arg == "--serve") {
+      serve = true;
+    } else if (arg == "--batch") {
+      batch = true;
+    } else if (arg == "--updates" && i + 1 < argc) {
+      updates_file_name = argv[++i];
+    } else if (arg == "--socket" && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+      PrintUsage();
+      return EXIT_FAILURE;
+    } else {
+      args.push_back(arg);
+    }
+  }
+
+  if (serve || !socket_path.empty()) {
+    Server server(options, ordering);
+    std::string error;
+    for (auto &data_file_name : args) {
+      if (!server.Load(data_file_name, error)) {
+        std::cerr << error << "\n";
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (serve) {
+      server.Serve(stdin, stdout);
+      return EXIT_SUCCESS;
+    }
+    server.Listen(socket_path);
+    return EXIT_FAILURE;
+  }
+
+  if (!updates_file_name.empty()) {
+    if (args.size() < 2) {
+      PrintUsage();
+      return EXIT_FAILURE;
+    }
+    Graph data(args[0]);
+    ContinuousMatcher matcher(data);
+    for (size_t i = 1; i < args.size(); ++i) matcher.AddQuery(args[i]);
+
+    if (updates_file_name == "-") {
+      RunUpdates(matcher, std::cin, count_only);
+    } else {
+      std::ifstream fin(updates_file_name);
+      if (!fin.is_open()) {
+        std::cerr << "Update file " << updates_file_name << " not found!\n";
+        return EXIT_FAILURE;
+      }
+      RunUpdates(matcher, fin, count_only);
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (batch) {
+    if (args.size() < 2) {
+      PrintUsage();
+      return EXIT_FAILURE;
+    }
+    Graph data(args[0]);
+    data.Reorder(ordering);
+
+    options.cancellation = &interrupt;
+    signal(SIGINT, Interrupt);
+    signal(SIGTERM, Interrupt);
+
+    MultiQueryMatcher matcher(data, options);
+    for (size_t i = 1; i < args.size(); ++i) matcher.AddQuery(args[i]);
+    std::cerr << "batch: " << matcher.GetNumQueries() << " queries, "
+              << matcher.GetNumQueryVertices() << " query vertices in "
+              << matcher.GetNumPatternVertices() << " pattern vertices\n";
+
+    std::vector<size_t> num_matches;
+    if (count_only) {
+      num_matches = matcher.CountMatches();
+    } else {
+      num_matches = matcher.FindMatches(
+          [](size_t query, const std::vector<Vertex> &embedding) {
+            printf("a %zu", query);
+            for (Vertex v : embedding) printf(" %d", v);
+            printf("\n");
+          });
+    }
+    for (size_t q = 0; q < num_matches.size(); ++q)
+      printf("n %zu %zu\n", q, num_matches[q]);
+    fflush(stdout);
+
+    if (matcher.IsInterrupted()) std::cerr << "search interrupted\n";
+    return EXIT_SUCCESS;
+  }
+
+  // a snapshot can be written from the data graph alone
+  size_t required_args = snapshot_file_name.empty() ? 2 : 1;
+  if (args.size() < required_args) {
+    PrintUsage();
     return EXIT_FAILURE;
   }
 
-  std::string data_file_name = argv[1];
-  std::string query_file_name = argv[2];
-  std::string candidate_set_file_name = argv[3];
+  std::string data_file_name = args[0];
 
   Graph data(data_file_name);
+  data.Reorder(ordering);
+
+  if (!snapshot_file_name.empty()) {
+    data.SaveSnapshot(snapshot_file_name);
+    if (args.size() < 2) return EXIT_SUCCESS;
+  }
+
+  std::string query_file_name = args[1];
+
   Graph query(query_file_name, true);
-  CandidateSet candidate_set(candidate_set_file_name);
+  CandidateSet candidate_set = args.size() < 3
+                                   ? CandidateSet(data, query)
+                                   : CandidateSet(args[2], data);
+  if (args.size() >= 3) candidate_set.CheckFits(data, query);
 
-  Backtrack backtrack;
+  if (refine) {
+    RefinementReport report =
+        candidate_set.MakeArcConsistent(data, query, options.num_threads);
+    fprintf(stderr,
+            "refinement: %zu -> %zu candidates (%zu by label, degree and "
+            "neighbor labels, %zu by arc consistency) in %zu rounds\n",
+            report.num_candidates_before, report.num_candidates_after,
+            report.num_local_removals, report.num_arc_removals,
+            report.num_rounds);
+  }
+
+  if (!candidates_file_name.empty())
+    candidate_set.SaveBinary(candidates_file_name, data);
+
+  if (dag_info) PrintDAGInfo(query, candidate_set, options.dag_frontier);
+
+  options.cancellation = &interrupt;
+  signal(SIGINT, Interrupt);
+  signal(SIGTERM, Interrupt);
+
+  Backtrack backtrack(options);
+
+  if (num_samples != 0) {
+    CountEstimate estimate =
+        backtrack.EstimateMatches(data, query, candidate_set, num_samples);
+    printf("%.6g [%.6g, %.6g] (%zu of %zu walks reached an embedding%s)\n",
+           estimate.estimate, estimate.low, estimate.high,
+           estimate.num_successes, estimate.num_samples,
+           estimate.reliable ? "" : ", unreliable");
+    return EXIT_SUCCESS;
+  }
 
-  backtrack.PrintAllMatches(data, query, candidate_set);
+  size_t num_matches;
+  if (count_only) {
+    num_matches = backtrack.CountMatches(data, query, candidate_set);
+    std::cout << num_matches << "\n";
+  } else {
+    num_matches = backtrack.PrintAllMatches(data, query, candidate_set);
+  }
+  fflush(stdout);
+
+  if (backtrack.IsInterrupted())
+    std::cerr << "search interrupted after " << num_matches
+              << " embeddings\n";
 
   return EXIT_SUCCESS;
 }
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    return Run(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -3,12 +3,61 @@
  *
  */
 #include "backtrack.h"
+#include "intersection.h"
+#include "query_symmetry.h"
+#include "search_worker.h"
+#include "task_pool.h"
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
 #include <ctime>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
 
 using namespace std;
 
-Backtrack::Backtrack() {}
+namespace {
+// how often the monitor checks the deadline and the cancellation token
+const std::chrono::milliseconds kMonitorTick(10);
+
+// two-sided 95% quantile of the normal distribution
+const double kConfidenceZ = 1.96;
+// fewest walks reaching an embedding for the normal confidence interval
+const size_t kMinSuccesses = 30;
+
+/**
+ * @brief Running mean and sum of squared deviations of a sample (Welford),
+ * which stay accurate when the values are huge and close to each other.
+ */
+struct RunningMoments {
+  size_t n = 0;
+  double mean = 0;
+  double m2 = 0;
+
+  void Add(double x) {
+    ++n;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+  }
+  void Merge(const RunningMoments &other) {
+    if (other.n == 0) return;
+    size_t total = n + other.n;
+    double delta = other.mean - mean;
+    mean += delta * other.n / total;
+    m2 += other.m2 + delta * delta * n * other.n / total;
+    n = total;
+  }
+};
+}  // namespace
+
+Backtrack::Backtrack() : interrupted_(false) {}
+Backtrack::Backtrack(const SearchOptions &options)
+    : options_(options), interrupted_(false) {}
 Backtrack::~Backtrack() {}
 
 /**
@@ -18,7 +67,7 @@ Backtrack::~Backtrack() {}
  */
 void checkMatch(const Graph &data, const Graph &query, const map<Vertex, Vertex> &uv_map){
   assert (uv_map.size() == query.GetNumVertices() && "uv_map is weird");
-  
+
   Vertex u1, v1, u2, v2;
   for (auto it1 = uv_map.begin(), end = uv_map.end(); it1 != end;){
     u1 = it1->first; v1 = it1->second;
@@ -26,7 +75,7 @@ void checkMatch(const Graph &data, const Graph &query, const map<Vertex, Vertex>
     assert (query.GetLabel(u1) == data.GetLabel(v1) && "label is different");
 
     for (auto it2 = ++it1, end = uv_map.end(); it2 != end; ++it2){
-      
+
       u2 = it2->first; v2 = it2->second;
       assert (!(query.IsNeighbor(u1, u2) && !data.IsNeighbor(v1, v2)) && "lost edge");
       assert (v1 != v2 && "same vertex matched");
@@ -37,191 +86,384 @@ void checkMatch(const Graph &data, const Graph &query, const map<Vertex, Vertex>
 /**
  * @brief Performs backtracking embedding search and produces the output file.
  *
- * @return void
+ * @param file destination of the embeddings, stdout by default.
+ * @return size_t the number of embeddings written.
  */
-void Backtrack::PrintAllMatches(const Graph &data, const Graph &query,
-                                const CandidateSet &cs) {
-  /* Unused */
-  // clock_t start = clock();
-  // int count = 0;
-  
+size_t Backtrack::PrintAllMatches(const Graph &data, const Graph &query,
+                                  const CandidateSet &cs, FILE *file) {
+  OutputSink sink(file, options_.output_format, query.GetNumVertices());
+
   // first output line
-  printf("t %lu\n", query.GetNumVertices());
+  sink.WriteHeader();
 
-  // query -> DAG
-  Graph *DAG = query.BuildDAG(cs);
-  
-  // start matching
-  const size_t numVertices = DAG->GetNumVertices();
-  
-  // Denote a vertex in query 'u', and a vertex in cs 'v'
-
-  // list of v we need to visit at each level
-  vector<vector<Vertex>> backtrack(numVertices+1);
-  // set of currently extendable u and its possible match v
-  set<tuple<int, Vertex, vector<Vertex>>> extendNext;
-  // stack of add diff for extendNext
-  vector<vector<tuple<int, Vertex, vector<Vertex>>>> extendNextAdded(numVertices+1);
-  // stack of remove diff for extendNext
-  vector<tuple<int, Vertex, vector<Vertex>>> extendNextRemoved(numVertices+1);
-  // record of u matched at each level
-  vector<Vertex> u_vector(numVertices+1);
-  // record of v matched at each level
-  vector<Vertex> v_vector(numVertices+1);
-  // index of v to visit next at each level
-  vector<int> idx(numVertices+1, 0);
-  // map of matched pairs <u, v>
-  map<Vertex, Vertex> uv_map;
-  // set of v currently matched
-  set<Vertex> v_set;
-  // indicate if we got up or down a level
-  bool levelDown = false;  
-  // set of result string "a ...\n"
-  set<string> found;
-  
-
-  // visit root of DAG at level 1
-  Vertex root = DAG->GetRoot();
-  for (size_t ci = 0; ci < cs.GetCandidateSize(root); ci++)
-    backtrack[1].push_back(cs.GetCandidate(root, ci));
-  u_vector[1] = root;
-  
-  // currently (level-1) vertices matched
-  long level = 1;
-  while (level != 0) {
-    if (levelDown) {
-      levelDown = false;
-      extendNext.insert(extendNextRemoved[level]);
-      v_set.erase(v_vector[level]);
-    }
+  return Search(data, query, cs, MatchMode::kPrint, nullptr, &sink);
+}
+
+/**
+ * @brief Returns the number of embeddings (at most options.limit, if set)
+ * without printing them.
+ *
+ * @return size_t
+ */
+size_t Backtrack::CountMatches(const Graph &data, const Graph &query,
+                               const CandidateSet &cs) {
+  return Search(data, query, cs, MatchMode::kCount, nullptr, nullptr);
+}
 
-    for (auto it = extendNextAdded[level].begin(); it != extendNextAdded[level].end(); it++) {
-      extendNext.erase(*it);
+/**
+ * @brief Passes every embedding to the callback until it returns false or
+ * options.limit embeddings have been found. With several threads the calls
+ * are serialized, so the callback need not be thread-safe.
+ *
+ * @return size_t the number of embeddings passed to the callback.
+ */
+size_t Backtrack::FindMatches(const Graph &data, const Graph &query,
+                              const CandidateSet &cs,
+                              const MatchCallback &callback) {
+  return Search(data, query, cs, MatchMode::kCallback, &callback, nullptr);
+}
+
+/**
+ * @brief Estimates the number of embeddings, as CountMatches without a limit
+ * would count them, from num_samples random walks over the candidate space
+ * (WanderJoin [4], with the candidate intersections of Alley [5]).
+ *
+ * A walk starts from a random candidate of the DAG root and, like the
+ * candidate-size order of the search, goes on with the extendable vertex
+ * (all parents matched) that has the fewest candidates adjacent to the data
+ * vertices of its parents. It maps that vertex to one of them chosen
+ * uniformly among the unused ones, and multiplies the weight of the walk by
+ * their number; a walk that runs out of candidates weighs 0. The next vertex
+ * only depends on the vertices matched so far, so an embedding is reached by
+ * a single walk, with the inverse of its weight as probability, and the mean
+ * weight is an unbiased estimate.
+ *
+ * With at least kMinSuccesses walks reaching an embedding, the interval is
+ * the 95% normal confidence interval of the mean. With fewer, the normal
+ * approximation does not hold (with none, the sample variance is 0); the
+ * estimate is flagged unreliable and the interval is [0, W p], where W, the
+ * product of the candidate set sizes, bounds the weight of a walk and p is
+ * a conservative 95% upper bound of the success rate of a walk, (k + 2
+ * sqrt(k) + 3) / n for k successes out of n (the rule of three for k = 0).
+ *
+ * The walks are split over options.num_threads threads, each with a generator
+ * seeded from seed and its index, so a seed and a number of threads always
+ * give the same estimate.
+ *
+ * @param num_samples number of walks.
+ * @param seed
+ * @return CountEstimate
+ */
+CountEstimate Backtrack::EstimateMatches(const Graph &data, const Graph &query,
+                                         const CandidateSet &cs,
+                                         size_t num_samples, uint64_t seed) {
+  CountEstimate result;
+  result.num_samples = num_samples;
+  size_t num_vertices = query.GetNumVertices();
+  size_t max_size = 0;
+  for (size_t u = 0; u < num_vertices; ++u) {
+    // no candidate for some vertex: no embedding, exactly
+    if (cs.GetCandidateSize(u) == 0) {
+      result.reliable = true;
+      return result;
     }
+    max_size = std::max(max_size, cs.GetCandidateSize(u));
+  }
+  if (num_samples == 0 || num_vertices == 0) {
+    result.high = std::numeric_limits<double>::infinity();
+    return result;
+  }
+
+  std::unique_ptr<Graph> DAG(query.BuildDAG(cs, options_.dag_frontier));
+  size_t num_threads =
+      std::min(GetNumThreads(options_.num_threads), num_samples);
+  CandidateSpace space(data, *DAG, cs, num_threads);
+  Vertex root = DAG->GetRoot();
+
+  // the extendable candidates of u are kept at slot[u] of a walk's arena
+  vector<size_t> slot(num_vertices + 1, 0);
+  double max_weight = 1;
+  for (size_t u = 0; u < num_vertices; ++u) {
+    slot[u + 1] = slot[u] + cs.GetCandidateSize(u) + kIntersectPadding;
+    max_weight *= cs.GetCandidateSize(u);
+  }
 
-    Vertex u = u_vector[level];
+  vector<RunningMoments> moments(num_threads);
+  vector<size_t> num_successes(num_threads, 0);
+  ParallelFor(0, num_samples, num_threads, [&](size_t begin, size_t end,
+                                               size_t t) {
+    std::seed_seq seeds{seed, static_cast<uint64_t>(t)};
+    std::mt19937_64 random(seeds);
+    vector<uint32_t> arena(slot[num_vertices]);
+    vector<size_t> size(num_vertices);
+    vector<uint32_t> position(num_vertices);
+    vector<size_t> num_waiting(num_vertices);
+    vector<Vertex> frontier;
+    vector<Vertex> matched;
+    frontier.reserve(num_vertices);
+    matched.reserve(num_vertices);
+    vector<char> used(data.GetNumVertices(), 0);
+    vector<uint32_t> buffer_a(max_size + kIntersectPadding);
+    vector<uint32_t> buffer_b(max_size + kIntersectPadding);
 
-    // current level search done
-    if (idx[level] >= (long)backtrack[level].size()) {
-      levelDown = true;
-      uv_map.erase(u);
-      level--;
-      idx[level]++;
-      continue;
+    // writes the candidates of u adjacent to the data vertices of all its
+    // parents to its slot, intersecting from the shortest list as
+    // SearchWorker does
+    auto intersect_parents = [&](Vertex u) {
+      size_t pb = DAG->GetParentStartOffset(u);
+      size_t pe = DAG->GetParentEndOffset(u);
+      size_t first = pb;
+      for (size_t e = pb + 1; e < pe; ++e) {
+        if (space.GetAdjacentSize(e, position[DAG->GetParent(e)]) <
+            space.GetAdjacentSize(first, position[DAG->GetParent(first)]))
+          first = e;
+      }
+      const uint32_t *src =
+          space.GetAdjacentBegin(first, position[DAG->GetParent(first)]);
+      size_t n = space.GetAdjacentSize(first, position[DAG->GetParent(first)]);
+      uint32_t *dst = buffer_a.data();
+      for (size_t e = pb; e < pe && n != 0; ++e) {
+        if (e == first) continue;
+        Vertex p = DAG->GetParent(e);
+        n = Intersect(src, n, space.GetAdjacentBegin(e, position[p]),
+                      space.GetAdjacentSize(e, position[p]), dst);
+        src = dst;
+        dst = dst == buffer_a.data() ? buffer_b.data() : buffer_a.data();
+      }
+      std::copy(src, src + n, arena.begin() + slot[u]);
+      size[u] = n;
+    };
+
+    // maps u to its candidate at position i, and makes the children of u
+    // whose parents are all matched extendable; false if one of them has
+    // no candidate left
+    auto match = [&](Vertex u, uint32_t i) {
+      position[u] = i;
+      matched.push_back(cs.GetCandidate(u, i));
+      used[matched.back()] = 1;
+      for (size_t j = DAG->GetNeighborStartOffset(u);
+           j < DAG->GetNeighborEndOffset(u); ++j) {
+        Vertex c = DAG->GetNeighbor(j);
+        if (--num_waiting[c] != 0) continue;
+        intersect_parents(c);
+        if (size[c] == 0) return false;
+        frontier.push_back(c);
+      }
+      return true;
+    };
+
+    for (size_t s = begin; s < end; ++s) {
+      for (size_t u = 0; u < num_vertices; ++u)
+        num_waiting[u] =
+            DAG->GetParentEndOffset(u) - DAG->GetParentStartOffset(u);
+      frontier.clear();
+
+      size_t n = cs.GetCandidateSize(root);
+      double weight = n;
+      bool stuck = !match(
+          root, std::uniform_int_distribution<size_t>(0, n - 1)(random));
+      while (!stuck && !frontier.empty()) {
+        size_t best = 0;
+        for (size_t i = 1; i < frontier.size(); ++i)
+          if (size[frontier[i]] < size[frontier[best]]) best = i;
+        Vertex u = frontier[best];
+        frontier[best] = frontier.back();
+        frontier.pop_back();
+
+        uint32_t *list = arena.data() + slot[u];
+        n = 0;
+        for (size_t i = 0; i < size[u]; ++i)
+          if (!used[cs.GetCandidate(u, list[i])]) list[n++] = list[i];
+        if (n == 0) {
+          stuck = true;
+          break;
+        }
+        weight *= n;
+        stuck = !match(
+            u, list[std::uniform_int_distribution<size_t>(0, n - 1)(random)]);
+      }
+
+      for (Vertex v : matched) used[v] = 0;
+      matched.clear();
+      if (stuck)
+        weight = 0;
+      else
+        ++num_successes[t];
+      moments[t].Add(weight);
     }
+  });
+
+  RunningMoments total;
+  for (size_t t = 0; t < num_threads; ++t) {
+    total.Merge(moments[t]);
+    result.num_successes += num_successes[t];
+  }
+  result.estimate = total.mean;
+  if (result.num_successes >= kMinSuccesses) {
+    double error = std::sqrt(total.m2 / (total.n - 1) / total.n);
+    result.low = std::max(0.0, total.mean - kConfidenceZ * error);
+    result.high = total.mean + kConfidenceZ * error;
+    result.reliable = true;
+  } else {
+    double k = result.num_successes;
+    double rate = std::min(1.0, (k + 2 * std::sqrt(k) + 3) / total.n);
+    result.low = 0;
+    result.high = max_weight * rate;
+  }
+  return result;
+}
+
+/**
+ * @brief Runs the search on options.num_threads threads.
+ *
+ * With more than one thread, every root candidate becomes a task. Workers
+ * that run out of tasks steal them from the others, and busy workers split
+ * their shallowest pending work whenever a worker is idle, so that skewed
+ * search trees are still shared.
+ *
+ * Unless options.symmetry_breaking is off, the automorphisms of the query are
+ * computed first; only canonical embeddings are searched, and each is
+ * expanded into its symmetric variants when reported (or counted as all of
+ * them).
+ *
+ * With options.factorize, the DAG leaves are left out of the search, and
+ * their assignments are counted, enumerated, or written as factorized
+ * records once the other query vertices are matched.
+ *
+ * With a time limit, a cancellation token or a progress callback, a monitor
+ * thread stops the workers at the deadline or on cancellation, and reports
+ * progress. Stopped workers flush what they found before returning.
+ *
+ * @return size_t the number of embeddings found.
+ */
+size_t Backtrack::Search(const Graph &data, const Graph &query,
+                         const CandidateSet &cs, MatchMode mode,
+                         const MatchCallback *callback, OutputSink *sink) {
+  // query -> DAG
+  Graph *DAG = query.BuildDAG(cs, options_.dag_frontier);
 
-    Vertex v = backtrack[level][idx[level]];
+  size_t num_threads = GetNumThreads(options_.num_threads);
+  SearchContext context(num_threads, options_, mode, callback, sink);
 
-    // v already matched
-    if (v_set.find(v) != v_set.end()) {
-      idx[level]++;
-      continue;
+  // adjacency between the candidates of adjacent query vertices
+  CandidateSpace space(data, *DAG, cs, num_threads);
+  bool factorize = options_.factorize ||
+                   (mode == MatchMode::kPrint &&
+                    options_.output_format == OutputFormat::kFactorized);
+  MatchingOrder order(*DAG, cs, space, options_.order, factorize);
+  std::unique_ptr<QuerySymmetry> symmetry;
+  if (options_.symmetry_breaking) {
+    symmetry.reset(new QuerySymmetry(query, order.GetPostponed()));
+    if (symmetry->IsTrivial()) symmetry.reset();
+  }
+
+  Vertex root = DAG->GetRoot();
+  double weight = 1.0 / std::max<size_t>(cs.GetCandidateSize(root), 1);
+  if (num_threads == 1) {
+    SearchTask task;
+    for (size_t ci = 0; ci < cs.GetCandidateSize(root); ci++)
+      task.candidates.push_back(ci);
+    task.weight = weight;
+    context.pool.Push(0, std::move(task));
+  } else {
+    for (size_t ci = 0; ci < cs.GetCandidateSize(root); ci++) {
+      SearchTask task;
+      task.candidates.push_back(ci);
+      task.weight = weight;
+      context.pool.Push(ci % num_threads, std::move(task));
     }
+  }
+
+  vector<std::unique_ptr<SearchWorker>> workers;
+  for (size_t i = 0; i < num_threads; i++)
+    workers.emplace_back(
+        new SearchWorker(data, *DAG, cs, space, order, symmetry.get(),
+                         context, i));
 
-    uv_map[u] = v;
-    v_set.insert(v);
-    extendNextAdded[level].clear();  
-
-    // if all u matched, print result
-    if (level == (long)numVertices) {
-      // assert (extendNext.size() == 0 && "extend next size should be 0");
-      
-      // // DUPLICATE EMBEDDING CHECK
-      // string result = "a";
-      // for (size_t i = 0; i < numVertices; i++)
-      //   result += " " + to_string(uv_map[i]);
-      // result += "\n";
-      // bool inserted = found.insert(result).second;
-      // assert (inserted && "already inserted");
-
-      printf("a");
-      for (size_t i = 0; i < numVertices; i++)
-        printf(" %d", uv_map[i]);
-      printf("\n");
-      
-      // count++;
-      // if (count == 100000) {
-      //   printf("count: %d, time: %ld\n", count, clock() - start);
-      //   return;
-      // }
-      
-      // // CORRECT EMBEDDING CHECK
-      // checkMatch(data, query, uv_map);
-
-      // idx[level]++;
-      // v_set.erase(v);
-      // continue;
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point start = Clock::now();
+  auto get_progress = [&]() {
+    SearchProgress progress = {0, 0, 0};
+    for (auto &worker : workers) {
+      progress.num_matches += worker->GetNumMatches();
+      progress.covered += worker->GetCovered();
     }
+    if (options_.limit != 0)
+      progress.num_matches =
+          std::min(context.num_matches.load(), options_.limit);
+    progress.covered = std::max(0.0, std::min(1.0, progress.covered));
+    progress.elapsed_seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    return progress;
+  };
 
-    // for all u's extendable children cu, add it to extendNext
-    bool cu_extendable = true;
-    for (size_t i = DAG->GetNeighborStartOffset(u); i < DAG->GetNeighborEndOffset(u); i++) {
-      Vertex cu = DAG->GetNeighbor(i);
-      vector<Vertex> candidates;
-      
-      // if a parent of cu is not matched, skip
-      bool hasAllParentMatched = true;
-      for (size_t pi = DAG->GetParentStartOffset(cu); pi < DAG->GetParentEndOffset(cu); pi++) {
-        Vertex p_cu = DAG->GetParent(pi);
-        if (uv_map.find(p_cu) == uv_map.end()) {
-          hasAllParentMatched = false;
-          break;
+  interrupted_ = false;
+  bool finished = false;
+  std::mutex monitor_mutex;
+  std::condition_variable monitor_cv;
+  std::thread monitor;
+  if (options_.time_limit > 0 || options_.cancellation || options_.progress) {
+    monitor = std::thread([&]() {
+      auto deadline = start + std::chrono::duration_cast<Clock::duration>(
+                                  std::chrono::duration<double>(
+                                      options_.time_limit));
+      auto interval = std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(options_.progress_interval));
+      auto next_report = start + interval;
+
+      std::unique_lock<std::mutex> lock(monitor_mutex);
+      while (!monitor_cv.wait_for(lock, kMonitorTick,
+                                  [&]() { return finished; })) {
+        Clock::time_point now = Clock::now();
+        if ((options_.time_limit > 0 && now >= deadline) ||
+            (options_.cancellation && options_.cancellation->IsCancelled())) {
+          interrupted_ = true;
+          context.stop = true;
         }
-      }
-      if (!hasAllParentMatched)
-        continue;
-
-      // find all possible v of cu, add it to extendNext
-      for (size_t ci = 0; ci < cs.GetCandidateSize(cu); ci++) {
-        Vertex cv = cs.GetCandidate(cu, ci);
-        bool cv_extendable = true;
-        if (v_set.find(cv) == v_set.end()) {
-          for (size_t pi = DAG->GetParentStartOffset(cu); pi < DAG->GetParentEndOffset(cu); pi++) {
-            Vertex p_cu = DAG->GetParent(pi);
-            if (!data.IsNeighbor(uv_map[p_cu], cv)) { 
-              cv_extendable = false;
-              break;
-            }
-          }
-          if (cv_extendable)
-            candidates.push_back(cv);
+        if (options_.progress && now >= next_report) {
+          options_.progress(get_progress());
+          next_report = now + interval;
         }
       }
-      // there is a cu that cannot be matched
-      if (candidates.size() == 0) {
-        cu_extendable = false;
-        break;
-      }
-      // for (auto it = extendNext.begin(); it != extendNext.end(); it++) {
-      //   assert (get<1>(*it) != cu && "cu");
-      // }
+    });
+  }
 
-      auto et = make_tuple(candidates.size(), cu, candidates);
-      extendNext.insert(et);
-      extendNextAdded[level].push_back(et);
-    }
-    
-    // if not extendable, proceed in same level
-    if (!cu_extendable || extendNext.size() == 0) {
-      idx[level]++;
-      v_set.erase(v);
-    }
-    // if extendable, go to next level
-    else {
-      auto p = *extendNext.begin();
-      extendNext.erase(p);
-      extendNextRemoved[level] = p;
-      v_vector[level] = v;
-      Vertex nextu = get<1>(p);
-      vector<Vertex> candidates = get<2>(p);
-      
-      level++;
-      idx[level] = 0;
-      u_vector[level] = nextu;
-      backtrack[level] = candidates;
-      extendNextAdded[level].clear();
+  vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++)
+    threads.emplace_back(&SearchWorker::Run, workers[i].get());
+  workers[0]->Run();
+  for (auto &thread : threads)
+    thread.join();
+
+  if (monitor.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(monitor_mutex);
+      finished = true;
     }
+    monitor_cv.notify_all();
+    monitor.join();
   }
+  if (options_.progress) options_.progress(get_progress());
 
   delete DAG;
+
+#ifdef SEARCH_STATS
+  if (!options_.stats_file.empty()) {
+    std::ofstream fout(options_.stats_file);
+    context.stats.WriteJSON(fout);
+  }
+#endif
+
+  size_t num_matches = context.num_matches.load();
+  if (options_.limit != 0)
+    num_matches = std::min(num_matches, options_.limit);
+  return num_matches;
 }
+
+/**
+ * @brief Returns true if the last search was stopped by its time limit or
+ * its cancellation token before it was complete.
+ *
+ * @return bool
+ */
+bool Backtrack::IsInterrupted() const { return interrupted_; }
@@ -4,40 +4,579 @@
  */
 
 #include "candidate_set.h"
+#include "file_format.h"
+#include "graph.h"
+#include "parallel.h"
 
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const char kBinaryMagic[8] = {'G', 'P', 'M', 'C', 'C', 'S', '0', '1'};
+const uint32_t kBinaryVersion = 1;
+
+/*
+ * Layout of a binary candidate set: the header, then the offsets and the
+ * candidates, each at an 8-byte aligned offset.
+ */
+struct BinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_query_vertices;
+  uint64_t num_candidates;
+  uint64_t offset_offset;
+  uint64_t candidates_offset;
+  uint64_t file_size;
+};
+
+inline const char *SkipWhitespace(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    ++p;
+  return p;
+}
+}  // namespace
+
+/**
+ * @brief Loads a candidate set from a text file or a binary file written by
+ * SaveBinary.
+ *
+ * @param filename candidate set file.
+ * @throw std::runtime_error if the file cannot be read or is malformed.
+ */
 CandidateSet::CandidateSet(const std::string& filename) {
-  std::ifstream fin(filename);
+  if (!std::ifstream(filename).is_open())
+    throw std::runtime_error("Candidate set file " + filename +
+                             " not found!");
+
+  if (IsBinary(filename))
+    LoadBinary(filename);
+  else
+    LoadText(filename);
+}
+
+/**
+ * @brief Reads a candidate set file written for the input file ids of data
+ * and translates it to the ids of data, which may have been reordered. The
+ * translated lists are sorted by id; ids that are not vertices of data are
+ * dropped.
+ *
+ * @param filename candidate set file.
+ * @param data data graph the candidates belong to.
+ */
+CandidateSet::CandidateSet(const std::string& filename, const Graph& data)
+    : CandidateSet(filename) {
+  if (!data.IsReordered()) return;
+
+  size_t num_query_vertices = GetNumQueryVertices();
+  Buffer<size_t> offset;
+  Buffer<Vertex> candidates;
+  offset.resize(num_query_vertices + 1);
+  candidates.resize(candidates_.size());
 
-  if (!fin.is_open()) {
-    std::cout << "Candidate set file " << filename << " not found!\n";
-    exit(EXIT_FAILURE);
+  size_t k = 0;
+  for (size_t u = 0; u < num_query_vertices; ++u) {
+    offset[u] = k;
+    for (size_t i = 0; i < GetCandidateSize(u); ++i) {
+      Vertex w = data.GetVertexID(GetCandidate(u, i));
+      if (w >= 0) candidates[k++] = w;
+    }
+    std::sort(candidates.begin() + offset[u], candidates.begin() + k);
+  }
+  offset[num_query_vertices] = k;
+  candidates.resize(k);
+
+  // the translated lists no longer borrow from a binary file
+  offset_.swap(offset);
+  candidates_.swap(candidates);
+  file_.reset();
+}
+
+/**
+ * @brief Parses the text format in a single pass over the mapped file.
+ * Records may come in any order; a later record of the same query vertex
+ * replaces an earlier one.
+ *
+ * @param filename text candidate set file.
+ */
+void CandidateSet::LoadText(const std::string& filename) {
+  MappedFile file(filename);
+  const char *p = file.GetData();
+  const char *end = p + file.GetSize();
+
+  // header: t <number of query vertices>
+  size_t num_query_vertices = 0;
+  p = SkipWhitespace(p, end);
+  if (p < end && *p == 't') p = ParseInt(p + 1, end, num_query_vertices);
+
+  // the candidates of u are values[first[u]] .. values[first[u] + size[u])
+  std::vector<size_t> first(num_query_vertices, 0);
+  std::vector<size_t> size(num_query_vertices, 0);
+  std::vector<Vertex> values;
+
+  while ((p = SkipWhitespace(p, end)) < end) {
+    if (*p++ != 'c') {
+      p = SkipLine(p, end);
+      continue;
+    }
+
+    Vertex id;
+    size_t num_candidates;
+    p = ParseInt(SkipWhitespace(p, end), end, id);
+    p = ParseInt(SkipWhitespace(p, end), end, num_candidates);
+    // every candidate takes at least one character
+    if (id < 0 || static_cast<size_t>(id) >= num_query_vertices ||
+        num_candidates > static_cast<size_t>(end - p))
+      throw std::runtime_error("Candidate set file " + filename +
+                               " is malformed!");
+
+    first[id] = values.size();
+    size[id] = num_candidates;
+    for (size_t i = 0; i < num_candidates; ++i) {
+      Vertex v;
+      p = ParseInt(SkipWhitespace(p, end), end, v);
+      values.push_back(v);
+    }
   }
 
-  char type;
-  size_t num_query_vertices;
+  offset_.resize(num_query_vertices + 1);
+  offset_[0] = 0;
+  for (size_t u = 0; u < num_query_vertices; ++u)
+    offset_[u + 1] = offset_[u] + size[u];
 
-  fin >> type >> num_query_vertices;
+  candidates_.resize(offset_[num_query_vertices]);
+  for (size_t u = 0; u < num_query_vertices; ++u)
+    std::copy(values.begin() + first[u], values.begin() + first[u] + size[u],
+              candidates_.begin() + offset_[u]);
+}
+
+/**
+ * @brief Maps a binary candidate set written by SaveBinary. No array is
+ * copied; the buffers point directly into the mapping.
+ *
+ * @param filename binary candidate set file.
+ */
+void CandidateSet::LoadBinary(const std::string& filename) {
+  file_ = std::make_shared<MappedFile>(filename);
+
+  BinaryHeader header;
+  if (file_->GetSize() < sizeof(header))
+    throw std::runtime_error("Candidate set file " + filename +
+                             " is truncated!");
+  std::memcpy(&header, file_->GetData(), sizeof(header));
+
+  if (header.version != kBinaryVersion ||
+      header.file_size != file_->GetSize())
+    throw std::runtime_error("Candidate set file " + filename +
+                             " has an unsupported version!");
+
+  BorrowArray(*file_, header.offset_offset, header.num_query_vertices + 1,
+              offset_);
+  BorrowArray(*file_, header.candidates_offset, header.num_candidates,
+              candidates_);
 
-  cs_.resize(num_query_vertices);
+  // every candidate lookup indexes candidates_ with these offsets unchecked
+  for (size_t u = 0; u < header.num_query_vertices; ++u)
+    if (offset_[u] > offset_[u + 1])
+      throw std::runtime_error("Candidate set file " + filename +
+                               " has decreasing offsets!");
+  if (offset_[0] != 0 ||
+      offset_[header.num_query_vertices] > header.num_candidates)
+    throw std::runtime_error("Candidate set file " + filename +
+                             " has offsets out of range!");
+}
 
-  while (fin >> type) {
-    if (type == 'c') {
-      Vertex id;
-      size_t candidate_set_size;
+/**
+ * @brief Returns true if the file starts with the magic bytes of the binary
+ * candidate set format.
+ *
+ * @param filename path of a candidate set file.
+ * @return bool
+ */
+bool CandidateSet::IsBinary(const std::string& filename) {
+  std::ifstream fin(filename, std::ios::binary);
+  char magic[sizeof(kBinaryMagic)];
 
-      fin >> id >> candidate_set_size;
+  if (!fin.read(magic, sizeof(magic))) return false;
+  return std::memcmp(magic, kBinaryMagic, sizeof(magic)) == 0;
+}
 
-      cs_[id].resize(candidate_set_size);
+/**
+ * @brief Writes the candidate set in the binary format, with the vertex ids
+ * of the data graph file like the text format.
+ *
+ * @param filename path of the binary file.
+ * @param data data graph the candidates belong to.
+ */
+void CandidateSet::SaveBinary(const std::string& filename,
+                              const Graph& data) const {
+  Buffer<Vertex> candidates;
+  candidates.resize(candidates_.size());
+  for (size_t i = 0; i < candidates_.size(); ++i)
+    candidates[i] = data.GetOriginalID(candidates_[i]);
 
-      for (size_t i = 0; i < candidate_set_size; ++i) {
-        Vertex data_vertex;
-        fin >> data_vertex;
-        cs_[id][i] = data_vertex;
+  BinaryHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kBinaryMagic, sizeof(kBinaryMagic));
+  header.version = kBinaryVersion;
+  header.num_query_vertices = GetNumQueryVertices();
+  header.num_candidates = candidates.size();
+
+  uint64_t offset = AlignUp(sizeof(header));
+  header.offset_offset = offset;
+  offset = AlignUp(offset + offset_.size() * sizeof(size_t));
+  header.candidates_offset = offset;
+  offset = AlignUp(offset + candidates.size() * sizeof(Vertex));
+  header.file_size = offset;
+
+  std::ofstream fout(TempFileName(filename),
+                     std::ios::binary | std::ios::trunc);
+
+  if (!fout.is_open())
+    throw std::runtime_error("Cannot write candidate set " + filename + "!");
+
+  fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  WriteArray(fout, offset_, header.offset_offset);
+  WriteArray(fout, candidates, header.candidates_offset);
+
+  // pad the last array so that the file size matches the header
+  fout.seekp(header.file_size - 1);
+  fout.put('\0');
+
+  CommitFile(fout, filename);
+}
+
+/**
+ * @brief Checks that a candidate set read from a file belongs to the query
+ * and data graphs, since the search indexes both with it unchecked.
+ *
+ * @param data
+ * @param query
+ * @throw std::runtime_error if the numbers of query vertices differ or some
+ * candidate is not a vertex of data.
+ */
+void CandidateSet::CheckFits(const Graph& data, const Graph& query) const {
+  if (GetNumQueryVertices() != query.GetNumVertices())
+    throw std::runtime_error("Candidate set has " +
+                             std::to_string(GetNumQueryVertices()) +
+                             " query vertices instead of " +
+                             std::to_string(query.GetNumVertices()) + "!");
+  for (Vertex v : candidates_)
+    if (v < 0 || static_cast<size_t>(v) >= data.GetNumVertices())
+      throw std::runtime_error("Candidate " + std::to_string(v) +
+                               " is not a data vertex!");
+}
+
+/**
+ * @brief Builds a bitmap of the candidates of every query vertex, so that
+ * IsCandidate answers in O(1). Takes |V(q)| |V(G)| / 8 bytes.
+ *
+ * @param num_data_vertices number of vertices of the data graph.
+ */
+void CandidateSet::BuildMembership(size_t num_data_vertices) {
+  membership_words_ = (num_data_vertices + 63) / 64;
+  membership_.assign(GetNumQueryVertices() * membership_words_, 0);
+  for (size_t u = 0; u < GetNumQueryVertices(); ++u) {
+    uint64_t *bits = &membership_[u * membership_words_];
+    for (size_t i = 0; i < GetCandidateSize(u); ++i) {
+      Vertex v = GetCandidate(u, i);
+      bits[v / 64] |= 1ULL << (v % 64);
+    }
+  }
+}
+
+namespace {
+// number of alternating refinement passes over the DAG (DAF uses three)
+const int kNumRefinements = 3;
+}  // namespace
+
+/**
+ * @brief Builds the candidate set of query in data without an external
+ * filter, following the DAG-graph dynamic programming of DAF [1].
+ *
+ * Initial candidates are filtered by label, degree and neighbor label
+ * frequency. The candidates are then refined along the query DAG, alternating
+ * between the reversed DAG (children) and the DAG (parents): v stays in C(u)
+ * only if for every such neighbor u' of u, some candidate of u' is adjacent
+ * to v.
+ *
+ * @param data data graph.
+ * @param query query graph.
+ */
+CandidateSet::CandidateSet(const Graph &data, const Graph &query) {
+  size_t num_query_vertices = query.GetNumVertices();
+  std::vector<std::vector<Vertex>> cs(num_query_vertices);
+
+  // group data vertices by label
+  std::vector<std::vector<Vertex>> vertices_by_label(data.GetNumLabels());
+  for (size_t v = 0; v < data.GetNumVertices(); ++v) {
+    Label l = data.GetLabel(v);
+    if (static_cast<size_t>(l) >= vertices_by_label.size())
+      vertices_by_label.resize(l + 1);
+    vertices_by_label[l].push_back(v);
+  }
+
+  for (size_t u = 0; u < num_query_vertices; ++u) {
+    Label l = query.GetLabel(u);
+    if (l < 0 || static_cast<size_t>(l) >= vertices_by_label.size()) continue;
+
+    // distinct labels of u's neighbors and how often each occurs
+    std::vector<std::pair<Label, size_t>> nlf;
+    for (size_t i = query.GetNeighborStartOffset(u);
+         i < query.GetNeighborEndOffset(u); ++i) {
+      Label nl = query.GetLabel(query.GetNeighbor(i));
+      if (nlf.empty() || nlf.back().first != nl)
+        nlf.emplace_back(nl, 1);
+      else
+        nlf.back().second += 1;
+    }
+
+    for (Vertex v : vertices_by_label[l]) {
+      if (data.GetDegree(v) < query.GetDegree(u)) continue;
+
+      bool nlf_ok = true;
+      for (auto &p : nlf) {
+        if (p.first < 0 ||
+            data.GetNeighborLabelFrequency(v, p.first) < p.second) {
+          nlf_ok = false;
+          break;
+        }
       }
+      if (nlf_ok) cs[u].push_back(v);
+    }
+  }
+
+  offset_.resize(num_query_vertices + 1);
+  offset_[0] = 0;
+  for (size_t u = 0; u < num_query_vertices; ++u)
+    offset_[u + 1] = offset_[u] + cs[u].size();
+  candidates_.resize(offset_[num_query_vertices]);
+  for (size_t u = 0; u < num_query_vertices; ++u)
+    std::copy(cs[u].begin(), cs[u].end(), candidates_.begin() + offset_[u]);
+  std::vector<std::vector<Vertex>>().swap(cs);
+
+  std::unique_ptr<Graph> dag(query.BuildDAG(*this));
+  std::vector<Vertex> order = dag->GetTopologicalOrder();
+
+  for (int i = 0; i < kNumRefinements; ++i) {
+    if (i % 2 == 0)
+      Refine(data, query, *dag,
+             std::vector<Vertex>(order.rbegin(), order.rend()), true);
+    else
+      Refine(data, query, *dag, order, false);
+  }
+}
+
+/**
+ * @brief One DP pass of the candidate set construction: visits the query
+ * vertices in the given order and keeps v in C(u) only if every child (or
+ * every parent) u' of u in the DAG has a candidate adjacent to v.
+ *
+ * @param data data graph.
+ * @param query query graph.
+ * @param dag DAG of query.
+ * @param order visiting order of the query vertices.
+ * @param use_children refine with children if true, with parents otherwise.
+ */
+void CandidateSet::Refine(const Graph &data, const Graph &query,
+                          const Graph &dag, const std::vector<Vertex> &order,
+                          bool use_children) {
+  // number of processed u' for which v has an adjacent candidate
+  std::vector<size_t> count(data.GetNumVertices(), 0);
+  std::vector<Vertex> touched;
+
+  // the kept candidates of u are moved to the front of its range, the gaps
+  // are closed at the end of the pass
+  size_t num_query_vertices = GetNumQueryVertices();
+  std::vector<size_t> size(num_query_vertices);
+  for (size_t u = 0; u < num_query_vertices; ++u) size[u] = GetCandidateSize(u);
+
+  for (Vertex u : order) {
+    Label l = query.GetLabel(u);
+    size_t begin = use_children ? dag.GetNeighborStartOffset(u)
+                                : dag.GetParentStartOffset(u);
+    size_t end = use_children ? dag.GetNeighborEndOffset(u)
+                              : dag.GetParentEndOffset(u);
+    if (begin == end || size[u] == 0) continue;
+
+    size_t k = 0;
+    for (size_t i = begin; i < end; ++i, ++k) {
+      Vertex nu = use_children ? dag.GetNeighbor(i) : dag.GetParent(i);
+      for (size_t c = 0; c < size[nu]; ++c) {
+        Vertex nv = GetCandidate(nu, c);
+        size_t last = data.GetNeighborEndOffset(nv, l);
+        for (size_t j = data.GetNeighborStartOffset(nv, l); j < last; ++j) {
+          Vertex v = data.GetNeighbor(j);
+          if (count[v] == k) {
+            if (k == 0) touched.push_back(v);
+            count[v] = k + 1;
+          }
+        }
+      }
+    }
+
+    Vertex *candidates = candidates_.data() + offset_[u];
+    size[u] = std::remove_if(candidates, candidates + size[u],
+                             [&](Vertex v) { return count[v] != k; }) -
+              candidates;
+
+    for (Vertex v : touched) count[v] = 0;
+    touched.clear();
+  }
+
+  Compact(size);
+}
+
+/**
+ * @brief Removes the gaps left by filtering the candidate lists in place:
+ * the candidates of u are the first size[u] entries of its range.
+ *
+ * @param size number of candidates kept for each query vertex.
+ */
+void CandidateSet::Compact(const std::vector<size_t> &size) {
+  size_t num_query_vertices = GetNumQueryVertices();
+  size_t n = 0;
+  for (size_t u = 0; u < num_query_vertices; ++u) {
+    size_t first = offset_[u];
+    offset_[u] = n;
+    if (n != first)
+      std::copy(candidates_.begin() + first,
+                candidates_.begin() + first + size[u],
+                candidates_.begin() + n);
+    n += size[u];
+  }
+  offset_[num_query_vertices] = n;
+  candidates_.resize(n);
+}
+
+/**
+ * @brief Refines the candidate set until it is arc consistent with the query.
+ *
+ * First, candidates whose label, degree or neighbor label frequencies
+ * cannot host their query vertex are removed; candidate set files from other
+ * tools do not always apply these filters. Then, in rounds, v is removed
+ * from C(u) if some query neighbor u' of u has no candidate adjacent to v.
+ * Each round checks the query vertices whose neighbors lost candidates in
+ * the previous round, in parallel against the membership bitmaps of the
+ * previous round, until a round removes nothing. Builds the membership
+ * bitmaps, which stay up to date.
+ *
+ * @param data data graph.
+ * @param query query graph.
+ * @param num_threads
+ * @return RefinementReport
+ */
+RefinementReport CandidateSet::MakeArcConsistent(const Graph &data,
+                                                 const Graph &query,
+                                                 size_t num_threads) {
+  RefinementReport report;
+  size_t num_query_vertices = GetNumQueryVertices();
+  num_threads = GetNumThreads(num_threads);
+  report.num_candidates_before = candidates_.size();
+
+  // lists are filtered in place, so borrowed ones are copied first
+  if (candidates_.IsBorrowed()) {
+    Buffer<size_t> offset(offset_);
+    Buffer<Vertex> candidates(candidates_);
+    offset_.swap(offset);
+    candidates_.swap(candidates);
+    file_.reset();
+  }
+
+  std::vector<size_t> size(num_query_vertices);
+  // candidates removed from each query vertex in the current round
+  std::vector<std::vector<Vertex>> removed(num_query_vertices);
+
+  ParallelFor(0, num_query_vertices, num_threads,
+              [&](size_t b, size_t e, size_t) {
+    for (size_t u = b; u < e; ++u) {
+      // distinct labels of u's neighbors and how often each occurs
+      std::vector<std::pair<Label, size_t>> nlf;
+      for (size_t i = query.GetNeighborStartOffset(u);
+           i < query.GetNeighborEndOffset(u); ++i) {
+        Label nl = query.GetLabel(query.GetNeighbor(i));
+        if (nlf.empty() || nlf.back().first != nl)
+          nlf.emplace_back(nl, 1);
+        else
+          nlf.back().second += 1;
+      }
+
+      Vertex *candidates = candidates_.data() + offset_[u];
+      size_t k = 0;
+      for (size_t i = 0; i < GetCandidateSize(u); ++i) {
+        Vertex v = candidates[i];
+        bool fits = v >= 0 &&
+                    static_cast<size_t>(v) < data.GetNumVertices() &&
+                    data.GetLabel(v) == query.GetLabel(u) &&
+                    data.GetDegree(v) >= query.GetDegree(u);
+        for (size_t j = 0; j < nlf.size() && fits; ++j)
+          fits = nlf[j].first >= 0 &&
+                 data.GetNeighborLabelFrequency(v, nlf[j].first) >=
+                     nlf[j].second;
+        if (fits) candidates[k++] = v;
+      }
+      size[u] = k;
+    }
+  });
+  for (size_t u = 0; u < num_query_vertices; ++u)
+    report.num_local_removals += GetCandidateSize(u) - size[u];
+  Compact(size);
+  BuildMembership(data.GetNumVertices());
+
+  std::vector<char> dirty(num_query_vertices, 1);
+  std::vector<Vertex> worklist;
+  while (true) {
+    worklist.clear();
+    for (size_t u = 0; u < num_query_vertices; ++u)
+      if (dirty[u]) worklist.push_back(u);
+    if (worklist.empty()) break;
+    ++report.num_rounds;
+
+    ParallelFor(0, worklist.size(), num_threads,
+                [&](size_t b, size_t e, size_t) {
+      for (size_t w = b; w < e; ++w) {
+        Vertex u = worklist[w];
+        Vertex *candidates = candidates_.data() + offset_[u];
+        size_t k = 0;
+        for (size_t i = 0; i < size[u]; ++i) {
+          Vertex v = candidates[i];
+          bool supported = true;
+          for (size_t j = query.GetNeighborStartOffset(u);
+               j < query.GetNeighborEndOffset(u) && supported; ++j) {
+            Vertex nu = query.GetNeighbor(j);
+            Label l = query.GetLabel(nu);
+            supported = false;
+            size_t last = data.GetNeighborEndOffset(v, l);
+            for (size_t x = data.GetNeighborStartOffset(v, l);
+                 x < last && !supported; ++x)
+              supported = IsCandidate(nu, data.GetNeighbor(x));
+          }
+          if (supported)
+            candidates[k++] = v;
+          else
+            removed[u].push_back(v);
+        }
+        size[u] = k;
+      }
+    });
+
+    // the bitmaps change only between rounds
+    std::fill(dirty.begin(), dirty.end(), 0);
+    for (Vertex u : worklist) {
+      if (removed[u].empty()) continue;
+      report.num_arc_removals += removed[u].size();
+      uint64_t *bits = &membership_[u * membership_words_];
+      for (Vertex v : removed[u]) bits[v / 64] &= ~(1ULL << (v % 64));
+      removed[u].clear();
+      for (size_t j = query.GetNeighborStartOffset(u);
+           j < query.GetNeighborEndOffset(u); ++j)
+        dirty[query.GetNeighbor(j)] = 1;
     }
   }
 
-  fin.close();
+  Compact(size);
+  report.num_candidates_after = candidates_.size();
+  return report;
 }
 
 CandidateSet::~CandidateSet() {}
@@ -0,0 +1,90 @@
+/**
+ * @file candidate_space.cc
+ *
+ */
+
+#include "candidate_space.h"
+#include "parallel.h"
+
+/**
+ * @brief Builds the index for every edge of the DAG. Children are split over
+ * num_threads threads.
+ *
+ * @param data data graph.
+ * @param dag DAG of the query built by Graph::BuildDAG.
+ * @param cs candidate set of the query.
+ * @param num_threads
+ */
+CandidateSpace::CandidateSpace(const Graph &data, const Graph &dag,
+                               const CandidateSet &cs, size_t num_threads) {
+  size_t num_query_vertices = dag.GetNumVertices();
+  size_t num_dag_edges = dag.GetParentStartOffset(num_query_vertices);
+
+  edge_offset_.resize(num_dag_edges + 1);
+  edge_offset_[0] = 0;
+  for (size_t c = 0; c < num_query_vertices; ++c) {
+    for (size_t e = dag.GetParentStartOffset(c); e < dag.GetParentEndOffset(c);
+         ++e)
+      edge_offset_[e + 1] =
+          edge_offset_[e] + cs.GetCandidateSize(dag.GetParent(e)) + 1;
+  }
+  offsets_.resize(edge_offset_[num_dag_edges]);
+
+  // adjacent positions of each edge, built independently per child
+  std::vector<std::vector<uint32_t>> edge_positions(num_dag_edges);
+
+  ParallelFor(0, num_query_vertices, GetNumThreads(num_threads),
+              [&](size_t begin, size_t end, size_t) {
+    // position of each data vertex in C(c), -1 if it is not a candidate
+    std::vector<int64_t> position(data.GetNumVertices(), -1);
+
+    for (size_t c = begin; c < end; ++c) {
+      if (dag.GetParentStartOffset(c) == dag.GetParentEndOffset(c) ||
+          cs.GetCandidateSize(c) == 0)
+        continue;
+
+      Label l = dag.GetLabel(c);
+      for (size_t j = 0; j < cs.GetCandidateSize(c); ++j)
+        position[cs.GetCandidate(c, j)] = j;
+
+      for (size_t e = dag.GetParentStartOffset(c);
+           e < dag.GetParentEndOffset(c); ++e) {
+        Vertex p = dag.GetParent(e);
+        size_t *offsets = &offsets_[edge_offset_[e]];
+        auto &positions = edge_positions[e];
+
+        offsets[0] = 0;
+        for (size_t i = 0; i < cs.GetCandidateSize(p); ++i) {
+          Vertex v = cs.GetCandidate(p, i);
+          size_t first = positions.size();
+          size_t end = data.GetNeighborEndOffset(v, l);
+          for (size_t k = data.GetNeighborStartOffset(v, l); k < end; ++k) {
+            int64_t j = position[data.GetNeighbor(k)];
+            if (j >= 0) positions.push_back(static_cast<uint32_t>(j));
+          }
+          std::sort(positions.begin() + first, positions.end());
+          offsets[i + 1] = positions.size();
+        }
+      }
+
+      for (size_t j = 0; j < cs.GetCandidateSize(c); ++j)
+        position[cs.GetCandidate(c, j)] = -1;
+    }
+  });
+
+  // concatenate the lists and make the offsets global
+  size_t total = 0;
+  for (auto &positions : edge_positions) total += positions.size();
+  positions_.reserve(total);
+
+  for (size_t e = 0; e < num_dag_edges; ++e) {
+    size_t base = positions_.size();
+    for (size_t k = edge_offset_[e]; k < edge_offset_[e + 1]; ++k)
+      offsets_[k] += base;
+    positions_.insert(positions_.end(), edge_positions[e].begin(),
+                      edge_positions[e].end());
+    std::vector<uint32_t>().swap(edge_positions[e]);
+  }
+}
+
+CandidateSpace::~CandidateSpace() {}
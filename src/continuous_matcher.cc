@@ -0,0 +1,307 @@
+/**
+ * @file continuous_matcher.cc
+ *
+ */
+
+#include "continuous_matcher.h"
+#include "file_format.h"
+
+#include <sstream>
+
+/**
+ * @brief Parses one update:
+ *
+ *   v <id> <label>      adds a vertex
+ *   e <v1> <v2>         adds an edge
+ *   -v <id>             removes a vertex and its edges
+ *   -e <v1> <v2>        removes an edge
+ *
+ * @param line
+ * @param update set to the parsed update.
+ * @return false if the line is not an update.
+ */
+bool ParseGraphUpdate(const std::string &line, GraphUpdate &update) {
+  std::istringstream stream(line);
+  std::string type;
+  if (!(stream >> type)) return false;
+
+  if (type == "v" || type == "-v") {
+    update.type = type == "v" ? GraphUpdate::kAddVertex
+                              : GraphUpdate::kRemoveVertex;
+    if (!(stream >> update.v1)) return false;
+    return type == "-v" || static_cast<bool>(stream >> update.label);
+  }
+  if (type == "e" || type == "-e") {
+    update.type =
+        type == "e" ? GraphUpdate::kAddEdge : GraphUpdate::kRemoveEdge;
+    return static_cast<bool>(stream >> update.v1 >> update.v2);
+  }
+  return false;
+}
+
+/**
+ * @param data initial data graph.
+ */
+ContinuousMatcher::ContinuousMatcher(const Graph &data) : graph_(data) {}
+ContinuousMatcher::~ContinuousMatcher() {}
+
+/**
+ * @brief Registers a query graph. Its embeddings in the current data graph
+ * are not reported; only the changes of the later updates are.
+ *
+ * @param filename text query graph file.
+ * @return size_t index of the query in the reports.
+ */
+size_t ContinuousMatcher::AddQuery(const std::string &filename) {
+  // labels that only the query has get a label now, so that vertices added
+  // with them later can match
+  {
+    MappedFile file(filename);
+    const char *p = file.GetData();
+    const char *end = p + file.GetSize();
+    while (p < end) {
+      p = SkipSpaces(p, end);
+      if (p < end && *p == 'v') {
+        Vertex id;
+        Label l;
+        p = ParseInt(ParseInt(p + 1, end, id), end, l);
+        graph_.AddLabel(l);
+      }
+      p = SkipLine(p, end);
+    }
+  }
+
+  Query query;
+  query.graph.reset(new Graph(filename, graph_.GetLabelMap()));
+  const Graph &q = *query.graph;
+  for (size_t x = 0; x < q.GetNumVertices(); ++x)
+    for (size_t i = q.GetNeighborStartOffset(x); i < q.GetNeighborEndOffset(x);
+         ++i)
+      query.orders.push_back(BuildOrder(q, x, q.GetNeighbor(i)));
+
+  queries_.push_back(std::move(query));
+  return queries_.size() - 1;
+}
+
+/**
+ * @brief Orders the query vertices after x and y greedily: next comes the
+ * vertex with the most ordered neighbors, then the highest degree, then the
+ * smallest id.
+ *
+ * @param query
+ * @param x query vertex matched to the first endpoint.
+ * @param y query vertex matched to the second endpoint.
+ * @return AnchoredOrder
+ */
+ContinuousMatcher::AnchoredOrder ContinuousMatcher::BuildOrder(
+    const Graph &query, Vertex x, Vertex y) const {
+  size_t n = query.GetNumVertices();
+  AnchoredOrder result;
+  std::vector<size_t> num_ordered(n, 0);
+  std::vector<char> ordered(n, 0);
+
+  result.backward_offset.push_back(0);
+  auto append = [&](Vertex u) {
+    result.order.push_back(u);
+    ordered[u] = 1;
+    for (size_t i = query.GetNeighborStartOffset(u);
+         i < query.GetNeighborEndOffset(u); ++i) {
+      Vertex w = query.GetNeighbor(i);
+      if (ordered[w])
+        result.backward.push_back(w);
+      else
+        ++num_ordered[w];
+    }
+    result.backward_offset.push_back(result.backward.size());
+  };
+
+  append(x);
+  append(y);
+  while (result.order.size() < n) {
+    Vertex next = -1;
+    for (size_t u = 0; u < n; ++u) {
+      if (ordered[u]) continue;
+      if (next < 0 || num_ordered[u] > num_ordered[next] ||
+          (num_ordered[u] == num_ordered[next] &&
+           query.GetDegree(u) > query.GetDegree(next)))
+        next = u;
+    }
+    append(next);
+  }
+  return result;
+}
+
+/**
+ * @brief Applies one update and reports the embeddings it creates or
+ * destroys.
+ *
+ * @param update
+ * @param callback
+ * @return false if the update does not apply (e.g. the edge already exists
+ * or a vertex is missing); the graph is then unchanged.
+ */
+bool ContinuousMatcher::Apply(const GraphUpdate &update,
+                              const DeltaCallback &callback) {
+  Vertex a = update.v1, b = update.v2;
+  auto has_edge = [this](Vertex a, Vertex b) {
+    return a != b && graph_.HasVertex(a) && graph_.HasVertex(b) &&
+           graph_.IsNeighbor(a, b);
+  };
+
+  switch (update.type) {
+    case GraphUpdate::kAddVertex:
+      if (!graph_.AddVertex(a, update.label)) return false;
+      used_.resize(graph_.GetNumVertices(), 0);
+      MatchVertex(a, true, callback);
+      return true;
+
+    case GraphUpdate::kRemoveVertex: {
+      if (!graph_.HasVertex(a)) return false;
+      std::vector<Vertex> neighbors(graph_.GetNeighborBegin(a),
+                                    graph_.GetNeighborEnd(a));
+      for (Vertex w : neighbors) {
+        MatchEdge(a, w, false, callback);
+        graph_.RemoveEdge(a, w);
+      }
+      MatchVertex(a, false, callback);
+      graph_.RemoveVertex(a);
+      return true;
+    }
+
+    case GraphUpdate::kAddEdge:
+      if (!graph_.AddEdge(a, b)) return false;
+      MatchEdge(a, b, true, callback);
+      return true;
+
+    case GraphUpdate::kRemoveEdge:
+      if (!has_edge(a, b)) return false;
+      MatchEdge(a, b, false, callback);
+      graph_.RemoveEdge(a, b);
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Applies the updates in order, reporting the changes of each.
+ *
+ * @param updates
+ * @param callback
+ * @return size_t number of updates that applied.
+ */
+size_t ContinuousMatcher::ApplyBatch(const std::vector<GraphUpdate> &updates,
+                                     const DeltaCallback &callback) {
+  size_t num_applied = 0;
+  for (auto &update : updates)
+    if (Apply(update, callback)) ++num_applied;
+  return num_applied;
+}
+
+/**
+ * @brief Reports the embeddings of every query that map a query edge to the
+ * edge (a, b), which must be in the graph.
+ *
+ * @param a
+ * @param b
+ * @param created
+ * @param callback
+ */
+void ContinuousMatcher::MatchEdge(Vertex a, Vertex b, bool created,
+                                  const DeltaCallback &callback) {
+  used_.resize(graph_.GetNumVertices(), 0);
+  for (size_t qi = 0; qi < queries_.size(); ++qi) {
+    const Graph &query = *queries_[qi].graph;
+    embedding_.assign(query.GetNumVertices(), -1);
+
+    for (auto &order : queries_[qi].orders) {
+      Vertex x = order.order[0], y = order.order[1];
+      if (graph_.GetLabel(a) != query.GetLabel(x) ||
+          graph_.GetLabel(b) != query.GetLabel(y) ||
+          graph_.GetDegree(a) < query.GetDegree(x) ||
+          graph_.GetDegree(b) < query.GetDegree(y))
+        continue;
+
+      embedding_[x] = a;
+      embedding_[y] = b;
+      used_[a] = used_[b] = 1;
+      Extend(qi, order, 2, created, callback);
+      used_[a] = used_[b] = 0;
+      embedding_[x] = embedding_[y] = -1;
+    }
+  }
+}
+
+/**
+ * @brief Reports v as the embedding of every single-vertex query it matches;
+ * the other queries have an edge in each embedding.
+ *
+ * @param v
+ * @param created
+ * @param callback
+ */
+void ContinuousMatcher::MatchVertex(Vertex v, bool created,
+                                    const DeltaCallback &callback) {
+  for (size_t qi = 0; qi < queries_.size(); ++qi) {
+    const Graph &query = *queries_[qi].graph;
+    if (query.GetNumVertices() != 1 || query.GetLabel(0) != graph_.GetLabel(v))
+      continue;
+    embedding_.assign(1, v);
+    callback(qi, created, embedding_);
+  }
+}
+
+/**
+ * @brief Matches order.order[k] and the vertices after it, then reports the
+ * embedding.
+ *
+ * @param query index of the query.
+ * @param order
+ * @param k
+ * @param created
+ * @param callback
+ */
+void ContinuousMatcher::Extend(size_t query, const AnchoredOrder &order,
+                               size_t k, bool created,
+                               const DeltaCallback &callback) {
+  if (k == order.order.size()) {
+    callback(query, created, embedding_);
+    return;
+  }
+
+  const Graph &q = *queries_[query].graph;
+  Vertex u = order.order[k];
+  Label l = q.GetLabel(u);
+  const Vertex *backward = order.backward.data() + order.backward_offset[k];
+  size_t num_backward = order.backward_offset[k + 1] - order.backward_offset[k];
+
+  auto try_vertex = [&](Vertex v, size_t skip) {
+    if (used_[v] || graph_.GetDegree(v) < q.GetDegree(u)) return;
+    for (size_t i = 0; i < num_backward; ++i)
+      if (i != skip && !graph_.IsNeighbor(embedding_[backward[i]], v)) return;
+    embedding_[u] = v;
+    used_[v] = 1;
+    Extend(query, order, k + 1, created, callback);
+    used_[v] = 0;
+    embedding_[u] = -1;
+  };
+
+  // a disconnected query: any vertex with the label
+  if (num_backward == 0) {
+    for (size_t v = 0; v < graph_.GetNumVertices(); ++v)
+      if (graph_.GetLabel(v) == l) try_vertex(v, 0);
+    return;
+  }
+
+  // scan the fewest neighbors with the label among the matched neighbors
+  size_t best = 0;
+  auto range = graph_.GetNeighbors(embedding_[backward[0]], l);
+  for (size_t i = 1; i < num_backward; ++i) {
+    auto other = graph_.GetNeighbors(embedding_[backward[i]], l);
+    if (other.second - other.first < range.second - range.first) {
+      range = other;
+      best = i;
+    }
+  }
+  for (const Vertex *v = range.first; v != range.second; ++v)
+    try_vertex(*v, best);
+}
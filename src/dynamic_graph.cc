@@ -0,0 +1,163 @@
+/**
+ * @file dynamic_graph.cc
+ *
+ */
+
+#include "dynamic_graph.h"
+
+/**
+ * @brief Copies a data graph, translating reordered vertex ids back to the
+ * ids of its file.
+ *
+ * @param graph data graph.
+ */
+DynamicGraph::DynamicGraph(const Graph &graph)
+    : num_edges_(graph.GetNumEdges()),
+      label_(graph.GetNumVertices()),
+      adj_(graph.GetNumVertices()),
+      label_map_(graph.GetLabelMap()),
+      num_labels_(0) {
+  for (Label l : label_map_) num_labels_ = std::max(num_labels_, l + 1);
+
+  for (size_t v = 0; v < graph.GetNumVertices(); ++v)
+    label_[graph.GetOriginalID(v)] = graph.GetLabel(v);
+
+  for (size_t v = 0; v < graph.GetNumVertices(); ++v) {
+    auto &neighbors = adj_[graph.GetOriginalID(v)];
+    for (size_t i = graph.GetNeighborStartOffset(v);
+         i < graph.GetNeighborEndOffset(v); ++i)
+      neighbors.push_back(graph.GetOriginalID(graph.GetNeighbor(i)));
+    std::sort(neighbors.begin(), neighbors.end(), [this](Vertex a, Vertex b) {
+      return label_[a] != label_[b] ? label_[a] < label_[b] : a < b;
+    });
+  }
+}
+
+DynamicGraph::~DynamicGraph() {}
+
+/**
+ * @brief Returns the neighbors of v with label l.
+ *
+ * @param v vertex id.
+ * @param l label.
+ * @return std::pair<const Vertex *, const Vertex *> [first, last).
+ */
+std::pair<const Vertex *, const Vertex *> DynamicGraph::GetNeighbors(
+    Vertex v, Label l) const {
+  const Vertex *begin = GetNeighborBegin(v);
+  const Vertex *end = GetNeighborEnd(v);
+  begin = std::lower_bound(begin, end, l, [this](Vertex w, Label l) {
+    return label_[w] < l;
+  });
+  end = std::upper_bound(begin, end, l, [this](Label l, Vertex w) {
+    return l < label_[w];
+  });
+  return std::make_pair(begin, end);
+}
+
+/**
+ * @brief Returns true if there is an edge between u and v.
+ *
+ * @param u vertex id.
+ * @param v vertex id.
+ * @return bool
+ */
+bool DynamicGraph::IsNeighbor(Vertex u, Vertex v) const {
+  if (GetDegree(u) > GetDegree(v)) std::swap(u, v);
+  return std::binary_search(
+      GetNeighborBegin(u), GetNeighborEnd(u), v, [this](Vertex a, Vertex b) {
+        return label_[a] != label_[b] ? label_[a] < label_[b] : a < b;
+      });
+}
+
+/**
+ * @brief Returns the position of v in the neighbors of u, or their end.
+ *
+ * @param u vertex id.
+ * @param v vertex id.
+ * @return std::vector<Vertex>::iterator
+ */
+std::vector<Vertex>::iterator DynamicGraph::FindNeighbor(Vertex u, Vertex v) {
+  return std::lower_bound(
+      adj_[u].begin(), adj_[u].end(), v, [this](Vertex a, Vertex b) {
+        return label_[a] != label_[b] ? label_[a] < label_[b] : a < b;
+      });
+}
+
+/**
+ * @brief Returns the label of raw_label, giving it a new label if it was not
+ * seen yet.
+ *
+ * @param raw_label label in the graph files.
+ * @return Label
+ */
+Label DynamicGraph::AddLabel(Label raw_label) {
+  if (raw_label < 0) return -1;
+  if (static_cast<size_t>(raw_label) >= label_map_.size())
+    label_map_.resize(raw_label + 1, -1);
+  if (label_map_[raw_label] < 0) label_map_[raw_label] = num_labels_++;
+  return label_map_[raw_label];
+}
+
+/**
+ * @brief Adds the isolated vertex v. Ids past the last vertex make room for
+ * the ids in between, which stay absent.
+ *
+ * @param v vertex id.
+ * @param raw_label label in the graph files.
+ * @return false if v already is a vertex or the arguments are invalid.
+ */
+bool DynamicGraph::AddVertex(Vertex v, Label raw_label) {
+  if (v < 0 || raw_label < 0 || HasVertex(v)) return false;
+  if (static_cast<size_t>(v) >= label_.size()) {
+    label_.resize(v + 1, -1);
+    adj_.resize(v + 1);
+  }
+  label_[v] = AddLabel(raw_label);
+  return true;
+}
+
+/**
+ * @brief Removes the vertex v, which must not have edges left.
+ *
+ * @param v vertex id.
+ * @return false if v is not a vertex or still has edges.
+ */
+bool DynamicGraph::RemoveVertex(Vertex v) {
+  if (!HasVertex(v) || GetDegree(v) != 0) return false;
+  label_[v] = -1;
+  std::vector<Vertex>().swap(adj_[v]);
+  return true;
+}
+
+/**
+ * @brief Adds the edge (u, v).
+ *
+ * @param u vertex id.
+ * @param v vertex id.
+ * @return false if the edge exists, is a loop or has a missing endpoint.
+ */
+bool DynamicGraph::AddEdge(Vertex u, Vertex v) {
+  if (u == v || !HasVertex(u) || !HasVertex(v) || IsNeighbor(u, v))
+    return false;
+  adj_[u].insert(FindNeighbor(u, v), v);
+  adj_[v].insert(FindNeighbor(v, u), u);
+  ++num_edges_;
+  return true;
+}
+
+/**
+ * @brief Removes the edge (u, v).
+ *
+ * @param u vertex id.
+ * @param v vertex id.
+ * @return false if there is no such edge.
+ */
+bool DynamicGraph::RemoveEdge(Vertex u, Vertex v) {
+  if (u == v || !HasVertex(u) || !HasVertex(v) || !IsNeighbor(u, v))
+    return false;
+  adj_[u].erase(FindNeighbor(u, v));
+  adj_[v].erase(FindNeighbor(v, u));
+  --num_edges_;
+  return true;
+}
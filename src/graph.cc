@@ -4,170 +4,445 @@
  */
 
 #include "graph.h"
+#include "file_format.h"
+#include "parallel.h"
+#include <atomic>
 #include <list>
 #include <set>
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
 
 using namespace std;
 
 namespace {
-std::vector<Label> transferred_label;
-void TransferLabel(const std::string &filename) {
-  std::ifstream fin(filename);
+// label map of the most recently loaded data graph, for Graph(filename, true)
+Buffer<Label> transferred_label;
 
-  if (!fin.is_open()) {
-    std::cout << "Graph file " << filename << " not found!\n";
-    exit(EXIT_FAILURE);
-  }
-
-  char type;
-  int32_t graph_id_;
-  size_t num_vertices_;
-
-  std::set<Label> label_set;
-
-  fin >> type >> graph_id_ >> num_vertices_;
+// records shorter than this are not worth a thread of their own
+const size_t kMinChunkBytes = 1 << 20;
 
-  // preprocessing
-  while (fin >> type) {
+/*
+ * Tokenizes the 'v' and 'e' records in [p, end). Vertex labels are written
+ * directly to raw_label since every vertex id appears once; edges are
+ * collected in this chunk's own list. Returns false if an edge has an
+ * endpoint that is not a vertex.
+ */
+bool ParseChunk(const char *p, const char *end, size_t num_vertices,
+                Label *raw_label,
+                std::vector<std::pair<Vertex, Vertex>> &edges) {
+  while (p < end) {
+    p = SkipSpaces(p, end);
+    if (p == end) break;
+
+    char type = *p++;
     if (type == 'v') {
       Vertex id;
       Label l;
-      fin >> id >> l;
-
-      label_set.insert(l);
+      p = ParseInt(p, end, id);
+      p = ParseInt(p, end, l);
+      if (id >= 0 && static_cast<size_t>(id) < num_vertices) raw_label[id] = l;
     } else if (type == 'e') {
       Vertex v1, v2;
-      Label l;
-      fin >> v1 >> v2 >> l;
+      p = ParseInt(p, end, v1);
+      p = ParseInt(p, end, v2);
+      if (v1 < 0 || static_cast<size_t>(v1) >= num_vertices || v2 < 0 ||
+          static_cast<size_t>(v2) >= num_vertices)
+        return false;
+      edges.emplace_back(v1, v2);
     }
+    p = SkipLine(p, end);
   }
+  return true;
+}
+
+/*
+ * Maps the labels that occur in the data graph to [0, |Σ|) in ascending
+ * order. Query graphs are loaded afterwards with the same mapping.
+ */
+void TransferLabel(const Buffer<Label> &raw_label, Buffer<Label> &label_map) {
+  Label max_raw_label = -1;
+  for (Label l : raw_label) max_raw_label = std::max(max_raw_label, l);
 
-  fin.close();
+  std::vector<bool> used(max_raw_label + 1, false);
+  for (Label l : raw_label)
+    if (l >= 0) used[l] = true;
 
-  transferred_label.resize(
-      *std::max_element(label_set.begin(), label_set.end()) + 1, -1);
+  label_map.assign(max_raw_label + 1, -1);
 
   Label new_label = 0;
-  for (Label l : label_set) {
-    transferred_label[l] = new_label;
-    new_label += 1;
+  for (Label l = 0; l <= max_raw_label; ++l) {
+    if (used[l]) {
+      label_map[l] = new_label;
+      new_label += 1;
+    }
   }
 }
 }  // namespace
 
 Graph::Graph(){}
 
+/**
+ * @brief Loads a graph from a text file or a snapshot.
+ *
+ * @param filename text graph file, or a snapshot written by SaveSnapshot.
+ * @param is_query whether the graph is a query graph; query labels are
+ * remapped with the table of the most recently loaded data graph.
+ * @throw std::runtime_error if the file cannot be read or is malformed.
+ */
 Graph::Graph(const std::string &filename, bool is_query) {
-  if (!is_query) {
-    TransferLabel(filename);
+  if (is_query) {
+    Load(filename, &transferred_label);
+  } else if (IsSnapshot(filename)) {
+    LoadSnapshot(filename);
+    transferred_label = label_map_;
+  } else {
+    Load(filename, nullptr);
+    transferred_label = label_map_;
   }
-  std::vector<std::vector<Vertex>> chd_list;
-
-  // Load Graph
-  std::ifstream fin(filename);
-  std::set<Label> label_set;
+}
 
-  if (!fin.is_open()) {
-    std::cout << "Graph file " << filename << " not found!\n";
-    exit(EXIT_FAILURE);
-  }
-  char type;
+/**
+ * @brief Loads a query graph whose labels are remapped with the table of the
+ * given data graph, so that queries against several resident data graphs do
+ * not depend on which one was loaded last.
+ *
+ * @param filename text query graph file.
+ * @param data data graph the query will be matched against.
+ */
+Graph::Graph(const std::string &filename, const Graph &data) {
+  Load(filename, &data.label_map_);
+}
 
-  fin >> type >> graph_id_ >> num_vertices_;
+/**
+ * @brief Loads a query graph whose labels are remapped with the given table,
+ * e.g. the one of a DynamicGraph.
+ *
+ * @param filename text query graph file.
+ * @param label_map label of the graph files -> label, -1 if absent.
+ */
+Graph::Graph(const std::string &filename, const Buffer<Label> &label_map) {
+  Load(filename, &label_map);
+}
 
-  chd_list.resize(num_vertices_);
+/**
+ * @brief Loads a graph from a text file in a single pass. The file is mapped,
+ * split into line-aligned chunks that are tokenized in parallel, and the CSR
+ * is built with a counting sort over the parsed edges.
+ *
+ * @param filename text graph file.
+ * @param label_map label map of a data graph for a query graph, or nullptr
+ * for a data graph, whose own map is computed into label_map_.
+ * @throw std::runtime_error if the file cannot be read, has no header, an
+ * edge between unknown vertices or a negative label.
+ */
+void Graph::Load(const std::string &filename, const Buffer<Label> *label_map) {
+  MappedFile file(filename);
+  const char *p = file.GetData();
+  const char *end = p + file.GetSize();
+
+  // header: t <graph id> <number of vertices>
+  char type = 0;
+  p = SkipSpaces(p, end);
+  if (p < end) type = *p++;
+  if (type != 't')
+    throw std::runtime_error("Graph file " + filename + " has no header!");
+  p = ParseInt(p, end, graph_id_);
+  p = ParseInt(p, end, num_vertices_);
+  p = SkipLine(p, end);
 
-  start_offset_.resize(num_vertices_ + 1);
   label_.resize(num_vertices_);
 
-  num_edges_ = 0;
-
-  // preprocessing
-  while (fin >> type) {
-    if (type == 'v') {
-      Vertex id;
-      Label l;
-      fin >> id >> l;
+  // tokenize line-aligned chunks in parallel
+  size_t num_threads = std::max<size_t>(
+      1, std::min(GetNumThreads(), static_cast<size_t>(end - p) /
+                                       kMinChunkBytes));
+  std::vector<const char *> chunk_begin(num_threads + 1);
+  chunk_begin[0] = p;
+  chunk_begin[num_threads] = end;
+  for (size_t t = 1; t < num_threads; ++t) {
+    const char *q = p + (end - p) * t / num_threads;
+    chunk_begin[t] = std::max(chunk_begin[t - 1], SkipLine(q - 1, end));
+  }
 
-      if (static_cast<size_t>(l) >= transferred_label.size())
-        l = -1;
-      else
-        l = transferred_label[l];
+  std::vector<std::vector<std::pair<Vertex, Vertex>>> edges(num_threads);
+  std::vector<char> parsed(num_threads);
+  ParallelFor(0, num_threads, num_threads,
+              [&](size_t b, size_t e, size_t) {
+                for (size_t t = b; t < e; ++t)
+                  parsed[t] =
+                      ParseChunk(chunk_begin[t], chunk_begin[t + 1],
+                                 num_vertices_, label_.data(), edges[t]);
+              });
+  for (char ok : parsed)
+    if (!ok)
+      throw std::runtime_error("Graph file " + filename +
+                               " has an edge between unknown vertices!");
+
+  if (label_map == nullptr) {
+    TransferLabel(label_, label_map_);
+    label_map = &label_map_;
+  }
 
-      label_[id] = l;
-      label_set.insert(l);
-    } else if (type == 'e') {
-      Vertex v1, v2;
-      Label l;
-      fin >> v1 >> v2 >> l;
+  // a query label that is not in the data graph gets a label no data vertex
+  // has, so that its vertex has no candidates and the query no embedding
+  Label absent_label = 0;
+  for (Label l : *label_map) absent_label = std::max(absent_label, l + 1);
 
-      chd_list[v1].push_back(v2);
-      chd_list[v2].push_back(v1);
+  std::set<Label> label_set;
+  for (size_t i = 0; i < num_vertices_; ++i) {
+    Label l = label_[i];
+    if (l < 0)
+      throw std::runtime_error("Graph file " + filename +
+                               " has a negative vertex label!");
+    if (static_cast<size_t>(l) >= label_map->size() || (*label_map)[l] < 0)
+      l = absent_label;
+    else
+      l = (*label_map)[l];
+    label_[i] = l;
+    label_set.insert(l);
+  }
 
-      num_edges_ += 1;
+  num_edges_ = 0;
+  for (auto &list : edges) num_edges_ += list.size();
+
+  // counting sort: degrees, prefix sums, then scatter
+  std::unique_ptr<std::atomic<size_t>[]> cursor(
+      new std::atomic<size_t>[num_vertices_ + 1]());
+  ParallelFor(0, num_threads, num_threads, [&](size_t b, size_t e, size_t) {
+    for (size_t t = b; t < e; ++t) {
+      for (auto &edge : edges[t]) {
+        cursor[edge.first].fetch_add(1, std::memory_order_relaxed);
+        cursor[edge.second].fetch_add(1, std::memory_order_relaxed);
+      }
     }
-  }
+  });
 
-  fin.close();
+  start_offset_.resize(num_vertices_ + 1);
+  start_offset_[0] = 0;
+  for (size_t i = 0; i < num_vertices_; ++i) {
+    start_offset_[i + 1] = start_offset_[i] + cursor[i].load();
+    cursor[i].store(start_offset_[i]);
+  }
 
   adj_array_.resize(num_edges_ * 2);
+  ParallelFor(0, num_threads, num_threads, [&](size_t b, size_t e, size_t) {
+    for (size_t t = b; t < e; ++t) {
+      for (auto &edge : edges[t]) {
+        adj_array_[cursor[edge.first].fetch_add(1)] = edge.second;
+        adj_array_[cursor[edge.second].fetch_add(1)] = edge.first;
+      }
+      std::vector<std::pair<Vertex, Vertex>>().swap(edges[t]);
+    }
+  });
+  cursor.reset();
 
   num_labels_ = label_set.size();
 
   max_label_ = *std::max_element(label_set.begin(), label_set.end());
 
   label_frequency_.resize(max_label_ + 1);
+  for (size_t i = 0; i < num_vertices_; ++i) label_frequency_[GetLabel(i)] += 1;
 
-  start_offset_by_label_.resize(num_vertices_ * (max_label_ + 1));
-
-  start_offset_[0] = 0;
-  for (size_t i = 0; i < chd_list.size(); ++i) {
-    start_offset_[i + 1] = start_offset_[i] + chd_list[i].size();
-  }
-
-  for (size_t i = 0; i < chd_list.size(); ++i) {
-    label_frequency_[GetLabel(i)] += 1;
-
-    auto &neighbors = chd_list[i];
-
-    if (neighbors.size() == 0) continue;
-
-    // sort neighbors by ascending order of label first, and descending order of
-    // degree second
-    std::sort(neighbors.begin(), neighbors.end(), [this](Vertex u, Vertex v) {
-      if (GetLabel(u) != GetLabel(v))
-        return GetLabel(u) < GetLabel(v);
-      else if (GetDegree(u) != GetDegree(v))
-        return GetDegree(u) > GetDegree(v);
-      else
-        return u < v;
-    });
+  SortNeighbors(GetNumThreads());
+  BuildLabelRuns(GetNumThreads());
+}
 
-    Vertex v = neighbors[0];
-    Label l = GetLabel(v);
+/**
+ * @brief Sorts the neighbors of every vertex by ascending order of label
+ * first, descending order of degree second and ascending id last. Vertices
+ * are split over num_threads threads.
+ *
+ * @param num_threads
+ */
+void Graph::SortNeighbors(size_t num_threads) {
+  ParallelFor(0, num_vertices_, num_threads, [&](size_t b, size_t e, size_t) {
+    for (size_t i = b; i < e; ++i) {
+      Vertex *neighbors = adj_array_.data() + start_offset_[i];
+      std::sort(neighbors, neighbors + GetDegree(i), [this](Vertex u, Vertex v) {
+        if (GetLabel(u) != GetLabel(v))
+          return GetLabel(u) < GetLabel(v);
+        else if (GetDegree(u) != GetDegree(v))
+          return GetDegree(u) > GetDegree(v);
+        else
+          return u < v;
+      });
+    }
+  });
+}
 
-    start_offset_by_label_[i * (max_label_ + 1) + l].first = start_offset_[i];
+/**
+ * @brief Builds the label runs of every vertex from adj_array_, whose
+ * neighbor lists must already be sorted by label. Vertices are split over
+ * num_threads threads.
+ *
+ * @param num_threads
+ */
+void Graph::BuildLabelRuns(size_t num_threads) {
+  label_run_offset_.resize(num_vertices_ + 1);
+  label_run_offset_[0] = 0;
+
+  // count the runs of every vertex, then prefix sums, then fill
+  ParallelFor(0, num_vertices_, num_threads, [&](size_t b, size_t e, size_t) {
+    for (size_t i = b; i < e; ++i) {
+      size_t num_runs = 0;
+      for (size_t j = start_offset_[i]; j < start_offset_[i + 1]; ++j)
+        if (j == start_offset_[i] ||
+            GetLabel(adj_array_[j]) != GetLabel(adj_array_[j - 1]))
+          ++num_runs;
+      label_run_offset_[i + 1] = num_runs;
+    }
+  });
+
+  for (size_t i = 0; i < num_vertices_; ++i)
+    label_run_offset_[i + 1] += label_run_offset_[i];
+
+  label_runs_.resize(label_run_offset_[num_vertices_]);
+  ParallelFor(0, num_vertices_, num_threads, [&](size_t b, size_t e, size_t) {
+    for (size_t i = b; i < e; ++i) {
+      LabelRun *run = label_runs_.data() + label_run_offset_[i];
+      for (size_t j = start_offset_[i]; j < start_offset_[i + 1]; ++j) {
+        Label l = GetLabel(adj_array_[j]);
+        if (j == start_offset_[i] || l != GetLabel(adj_array_[j - 1])) {
+          run->label = l;
+          run->offset = static_cast<uint32_t>(j - start_offset_[i]);
+          ++run;
+        }
+      }
+    }
+  });
+}
 
-    for (size_t j = 1; j < neighbors.size(); ++j) {
-      v = neighbors[j];
-      Label next_l = GetLabel(v);
+namespace {
+/*
+ * Vertices sorted by label, then by descending degree, then by id.
+ */
+std::vector<Vertex> LabelDegreeOrder(const Graph &graph) {
+  std::vector<Vertex> order(graph.GetNumVertices());
+  for (size_t v = 0; v < order.size(); ++v) order[v] = v;
+  std::sort(order.begin(), order.end(), [&](Vertex u, Vertex v) {
+    if (graph.GetLabel(u) != graph.GetLabel(v))
+      return graph.GetLabel(u) < graph.GetLabel(v);
+    else if (graph.GetDegree(u) != graph.GetDegree(v))
+      return graph.GetDegree(u) > graph.GetDegree(v);
+    else
+      return u < v;
+  });
+  return order;
+}
 
-      if (l != next_l) {
-        start_offset_by_label_[i * (max_label_ + 1) + l].second =
-            start_offset_[i] + j;
-        start_offset_by_label_[i * (max_label_ + 1) + next_l].first =
-            start_offset_[i] + j;
-        l = next_l;
+/*
+ * Breadth-first order of every connected component. With cuthill_mckee, each
+ * component starts from a vertex of minimum degree and the unvisited
+ * neighbors of a vertex are visited by ascending degree; otherwise a
+ * component starts from a vertex of maximum degree and neighbors are visited
+ * in adjacency list order.
+ */
+std::vector<Vertex> BreadthFirstOrder(const Graph &graph, bool cuthill_mckee) {
+  size_t num_vertices = graph.GetNumVertices();
+  std::vector<Vertex> seeds(num_vertices);
+  for (size_t v = 0; v < num_vertices; ++v) seeds[v] = v;
+  std::stable_sort(seeds.begin(), seeds.end(), [&](Vertex u, Vertex v) {
+    return cuthill_mckee ? graph.GetDegree(u) < graph.GetDegree(v)
+                         : graph.GetDegree(u) > graph.GetDegree(v);
+  });
+
+  std::vector<char> visited(num_vertices, 0);
+  std::vector<Vertex> order;
+  order.reserve(num_vertices);
+  for (Vertex seed : seeds) {
+    if (visited[seed]) continue;
+    visited[seed] = 1;
+    order.push_back(seed);
+
+    for (size_t head = order.size() - 1; head < order.size(); ++head) {
+      Vertex v = order[head];
+      size_t first = order.size();
+      for (size_t i = graph.GetNeighborStartOffset(v);
+           i < graph.GetNeighborEndOffset(v); ++i) {
+        Vertex n = graph.GetNeighbor(i);
+        if (visited[n]) continue;
+        visited[n] = 1;
+        order.push_back(n);
       }
+      if (cuthill_mckee)
+        std::stable_sort(order.begin() + first, order.end(),
+                         [&](Vertex u, Vertex w) {
+                           return graph.GetDegree(u) < graph.GetDegree(w);
+                         });
     }
+  }
+  return order;
+}
+}  // namespace
 
-    start_offset_by_label_[i * (max_label_ + 1) + l].second =
-        start_offset_[i + 1];
+/**
+ * @brief Renumbers the vertices of this data graph in the given order and
+ * rebuilds the CSR, so that vertices accessed together by the search share
+ * cache lines and pages. The ids of the input file stay available through
+ * GetOriginalID and GetVertexID; reordering a reordered graph composes both.
+ *
+ * @param ordering kNone leaves the graph as it is.
+ */
+void Graph::Reorder(VertexOrdering ordering) {
+  std::vector<Vertex> order;  // old id of each new id
+  switch (ordering) {
+    case VertexOrdering::kNone:
+      return;
+    case VertexOrdering::kLabelDegree:
+      order = LabelDegreeOrder(*this);
+      break;
+    case VertexOrdering::kBFS:
+      order = BreadthFirstOrder(*this, false);
+      break;
+    case VertexOrdering::kRCM:
+      order = BreadthFirstOrder(*this, true);
+      std::reverse(order.begin(), order.end());
+      break;
+  }
 
-    std::copy(chd_list[i].begin(), chd_list[i].end(),
-              adj_array_.begin() + start_offset_[i]);
+  size_t num_threads = GetNumThreads();
+  std::vector<Vertex> new_id(num_vertices_);
+  for (size_t v = 0; v < num_vertices_; ++v) new_id[order[v]] = v;
+
+  Buffer<Label> label;
+  Buffer<size_t> start_offset;
+  Buffer<Vertex> adj_array;
+  label.resize(num_vertices_);
+  start_offset.resize(num_vertices_ + 1);
+  adj_array.resize(adj_array_.size());
+
+  start_offset[0] = 0;
+  for (size_t v = 0; v < num_vertices_; ++v) {
+    label[v] = label_[order[v]];
+    start_offset[v + 1] = start_offset[v] + GetDegree(order[v]);
   }
+  ParallelFor(0, num_vertices_, num_threads, [&](size_t b, size_t e, size_t) {
+    for (size_t v = b; v < e; ++v) {
+      Vertex *neighbors = adj_array.data() + start_offset[v];
+      for (size_t i = GetNeighborStartOffset(order[v]);
+           i < GetNeighborEndOffset(order[v]); ++i)
+        *neighbors++ = new_id[GetNeighbor(i)];
+    }
+  });
+
+  Buffer<Vertex> original_id, vertex_id;
+  original_id.resize(num_vertices_);
+  vertex_id.resize(num_vertices_);
+  for (size_t v = 0; v < num_vertices_; ++v) {
+    original_id[v] = GetOriginalID(order[v]);
+    vertex_id[original_id[v]] = v;
+  }
+
+  // the old arrays may be borrowed from a snapshot, which stays mapped
+  label_.swap(label);
+  start_offset_.swap(start_offset);
+  adj_array_.swap(adj_array);
+  original_id_.swap(original_id);
+  vertex_id_.swap(vertex_id);
+
+  SortNeighbors(num_threads);
+  BuildLabelRuns(num_threads);
 }
 
 /**
@@ -187,21 +462,133 @@ bool isDAG(Vertex v, Graph &g){
   return true;
 }
 
+namespace {
+const size_t kNotInHeap = static_cast<size_t>(-1);
+
+/*
+ * Binary min-heap of vertices that knows the position of every vertex, so
+ * that the key of a queued vertex can be changed in O(log n). Ties go to the
+ * larger vertex id.
+ */
+class IndexedHeap {
+ public:
+  explicit IndexedHeap(size_t n) : key_(n), index_(n, kNotInHeap) {}
+
+  bool Empty() const { return heap_.empty(); }
+  bool Contains(Vertex v) const { return index_[v] != kNotInHeap; }
+
+  void Push(Vertex v, double key) {
+    key_[v] = key;
+    index_[v] = heap_.size();
+    heap_.push_back(v);
+    SiftUp(index_[v]);
+  }
+
+  void Update(Vertex v, double key) {
+    key_[v] = key;
+    SiftUp(index_[v]);
+    SiftDown(index_[v]);
+  }
+
+  Vertex Pop() {
+    Vertex top = heap_[0];
+    Swap(0, heap_.size() - 1);
+    heap_.pop_back();
+    index_[top] = kNotInHeap;
+    if (!heap_.empty()) SiftDown(0);
+    return top;
+  }
+
+ private:
+  bool Less(size_t i, size_t j) const {
+    Vertex a = heap_[i], b = heap_[j];
+    return key_[a] < key_[b] || (key_[a] == key_[b] && a > b);
+  }
+
+  void Swap(size_t i, size_t j) {
+    std::swap(heap_[i], heap_[j]);
+    index_[heap_[i]] = i;
+    index_[heap_[j]] = j;
+  }
+
+  void SiftUp(size_t i) {
+    while (i > 0 && Less(i, (i - 1) / 2)) {
+      Swap(i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  }
+
+  void SiftDown(size_t i) {
+    while (true) {
+      size_t smallest = i;
+      size_t left = 2 * i + 1, right = left + 1;
+      if (left < heap_.size() && Less(left, smallest)) smallest = left;
+      if (right < heap_.size() && Less(right, smallest)) smallest = right;
+      if (smallest == i) return;
+      Swap(i, smallest);
+      i = smallest;
+    }
+  }
+
+  std::vector<double> key_;
+  std::vector<size_t> index_;
+  std::vector<Vertex> heap_;
+};
+
+/*
+ * Fenwick tree of the visited vertex ids, counting those in a range in
+ * O(log n).
+ */
+class VisitedCounter {
+ public:
+  explicit VisitedCounter(size_t n) : tree_(n + 1, 0) {}
+
+  void Add(Vertex v) {
+    for (size_t i = v + 1; i < tree_.size(); i += i & (~i + 1)) tree_[i]++;
+  }
+
+  // number of visited ids in [begin, end)
+  size_t Count(size_t begin, size_t end) const {
+    end = std::min(end, tree_.size() - 1);
+    begin = std::min(begin, end);
+    return Prefix(end) - Prefix(begin);
+  }
+
+ private:
+  size_t Prefix(size_t end) const {
+    size_t count = 0;
+    for (size_t i = end; i > 0; i -= i & (~i + 1)) count += tree_[i];
+    return count;
+  }
+
+  std::vector<size_t> tree_;
+};
+
+inline bool TestBit(const std::vector<uint64_t> &bits, size_t i) {
+  return bits[i / 64] >> (i % 64) & 1;
+}
+
+inline void SetBit(std::vector<uint64_t> &bits, size_t i) {
+  bits[i / 64] |= 1ULL << (i % 64);
+}
+}  // namespace
+
 /**
  * @brief Builds a DAG of this graph and returns its pointer.
  *
+ * The root is the vertex with the smallest |C(u)| / deg(u), the smallest id
+ * on ties. The other vertices are visited from a heap of the frontier,
+ * ordered by the given key (see DAGFrontier) and then by the larger id, as
+ * the original builder did. Each edge is directed from the endpoint visited
+ * first. The layers of the result are the breadth-first layers from the
+ * root. Runs in O((V + E) log V).
+ *
+ * @param cs candidate sets of this graph.
+ * @param frontier key of the frontier heap.
  * @return DAG graph
+ * @throw std::runtime_error if this graph is not connected.
  */
-Graph *Graph::BuildDAG(const CandidateSet &cs) const {
-  // one-sided version of adj_list (parent->child)
-  std::vector<std::vector<Vertex>> chd_list(num_vertices_);
-  // inverse of chd_list (child->parent)
-  std::vector<std::vector<Vertex>> par_list(num_vertices_);
-
-  std::set<Vertex> visited;
-  vector<pair<size_t, size_t>> toVisit(num_vertices_, make_pair(0, 0));
-  size_t count_edges = 0;   /* Unused. (debugging purpose) */
-
+Graph *Graph::BuildDAG(const CandidateSet &cs, DAGFrontier frontier) const {
   // select the vertex with min{|cs| / deg} as root
   Vertex root = 0;
   double minVal = __DBL_MAX__;
@@ -214,46 +601,69 @@ Graph *Graph::BuildDAG(const CandidateSet &cs) const {
       minVal = val;
     }
   }
-  visited.insert(root);
-  for (size_t i = GetNeighborStartOffset(root); i < GetNeighborEndOffset(root); i++) {
-    Vertex n = GetNeighbor(i);
-    toVisit[n] = make_pair(cs.GetCandidateSize(n), GetDegree(n));
+
+  // breadth-first layers from the root, which also checks that every vertex
+  // can be reached
+  std::vector<size_t> layer(num_vertices_, num_vertices_);
+  std::vector<Vertex> queue;
+  queue.reserve(num_vertices_);
+  if (num_vertices_ > 0) {
+    layer[root] = 0;
+    queue.push_back(root);
   }
-  
-  // build chd_list, par_list in O(V^2)
-  for (size_t i = 0; i < num_vertices_ - 1; i++) {
-    Vertex v = -1;
-    minVal = __DBL_MAX__;
-    for (size_t j = 0; j < num_vertices_; j++) {
-      if (toVisit[j].first != 0 && visited.find(j) == visited.end()) {
-        double val = toVisit[j].first / (toVisit[j].second + 0.000001);
-        assert(val <= __DBL_MAX__);
-        if (val <= minVal) {
-          v = j;
-          minVal = val;
-        }
-      }
-    }
-    // assert(v != -1);
-    visited.insert(v);
-    for (size_t i = GetNeighborStartOffset(v); i < GetNeighborEndOffset(v); i++) {
+  for (size_t q = 0; q < queue.size(); q++) {
+    Vertex v = queue[q];
+    for (size_t i = GetNeighborStartOffset(v); i < GetNeighborEndOffset(v);
+         i++) {
       Vertex n = GetNeighbor(i);
-      size_t newDeg = GetDegree(n);
-      for (size_t j = GetNeighborStartOffset(n); j < GetNeighborEndOffset(n); j++) {
-        if (visited.find(j) != visited.end())
-          newDeg--;
-      }
-      toVisit[n] = make_pair(cs.GetCandidateSize(n), newDeg);
+      if (layer[n] != num_vertices_) continue;
+      layer[n] = layer[v] + 1;
+      queue.push_back(n);
     }
-
-    // update chd_list, par_list
-    for (size_t i = GetNeighborStartOffset(v); i < GetNeighborEndOffset(v); i++) {
-      Vertex u = adj_array_[i];
-      if (visited.find(u) != visited.end()) {
-        chd_list[u].push_back(v);
-        par_list[v].push_back(u);
-        count_edges += 1;
-      }
+  }
+  if (queue.size() != num_vertices_)
+    throw std::runtime_error("query graph is not connected");
+
+  // unvisited neighbors of each vertex
+  std::vector<size_t> remaining(num_vertices_);
+  for (size_t i = 0; i < num_vertices_; i++) remaining[i] = GetDegree(i);
+  VisitedCounter visited_ids(num_vertices_);
+  auto key = [&](Vertex v, Vertex from) {
+    size_t degree = remaining[v];
+    if (frontier == DAGFrontier::kLegacy) {
+      degree = GetDegree(v);
+      // the original builder did not discount anything for the root
+      if (from != root)
+        degree -= visited_ids.Count(GetNeighborStartOffset(v),
+                                    GetNeighborEndOffset(v));
+    }
+    return cs.GetCandidateSize(v) / (degree + 0.000001);
+  };
+
+  std::vector<uint64_t> visited((num_vertices_ + 63) / 64, 0);
+  // position of each vertex in the visit order
+  std::vector<size_t> rank(num_vertices_, num_vertices_);
+  std::vector<Vertex> order;
+  order.reserve(num_vertices_);
+
+  IndexedHeap heap(num_vertices_);
+  if (num_vertices_ > 0) heap.Push(root, 0);
+  while (!heap.Empty()) {
+    Vertex v = heap.Pop();
+    SetBit(visited, v);
+    visited_ids.Add(v);
+    rank[v] = order.size();
+    order.push_back(v);
+
+    for (size_t i = GetNeighborStartOffset(v); i < GetNeighborEndOffset(v);
+         i++) {
+      Vertex n = GetNeighbor(i);
+      remaining[n]--;
+      if (TestBit(visited, n)) continue;
+      if (heap.Contains(n))
+        heap.Update(n, key(n, v));
+      else
+        heap.Push(n, key(n, v));
     }
   }
 
@@ -267,106 +677,235 @@ Graph *Graph::BuildDAG(const CandidateSet &cs) const {
   result->num_edges_ = num_edges_;
   result->num_labels_ = num_labels_;
   result->max_label_ = max_label_;
-  result->label_frequency_.resize(max_label_+1);
-  std::copy(label_frequency_.begin(), label_frequency_.end(), result->label_frequency_.begin());
-  result->label_.resize(num_vertices_);
-  std::copy(label_.begin(), label_.end(), result->label_.begin());
+  result->label_frequency_ = label_frequency_;
+  result->label_ = label_;
 
-  // set result->start_offset_/start_offset_by_label_/adj_array_
+  // children (later in the visit order) and parents (earlier) keep the
+  // label/degree/id order of the adjacency lists
   result->start_offset_.resize(num_vertices_ + 1);
-  result->start_offset_by_label_.resize(num_vertices_ * (max_label_ + 1));
-  result->adj_array_.resize(num_edges_);
-
+  result->start_offset_par_.resize(num_vertices_ + 1);
   result->start_offset_[0] = 0;
-  for (size_t i = 0; i < chd_list.size(); i++) {
-    auto &neighbors = chd_list[i];
-
-    // fill start_offset_
-    result->start_offset_[i+1]
-      = result->start_offset_[i] + neighbors.size();
-
-    // if no outgoing edge, done
-    if(!neighbors.size()) continue;
-
-    // sort neighbors by asc label, desc degree
-    std::sort(neighbors.begin(), neighbors.end(), [this](Vertex u, Vertex v) {
-      if (GetLabel(u) != GetLabel(v))
-        return GetLabel(u) < GetLabel(v);
-      else if (GetDegree(u) != GetDegree(v))
-        return GetDegree(u) > GetDegree(v);
-      else
-        return u < v;
-    });
-    
-    // fill start_offset_by_label_
-    Vertex v = neighbors[0];
-    Label l = GetLabel(v);
-    result->start_offset_by_label_[i * (max_label_ + 1) + l].first =
-        result->start_offset_[i];
-    for (size_t j = 1; j < chd_list[i].size(); ++j) {
-      v = neighbors[j];
-      Label next_l = GetLabel(v);
-      if (l != next_l) {
-        result->start_offset_by_label_[i * (max_label_ + 1) + l].second =
-            result->start_offset_[i] + j;
-        result->start_offset_by_label_[i * (max_label_ + 1) + next_l].first =
-            result->start_offset_[i] + j;
-        l = next_l;
-      }
+  result->start_offset_par_[0] = 0;
+  for (size_t i = 0; i < num_vertices_; i++) {
+    size_t num_children = 0, num_parents = 0;
+    for (size_t j = GetNeighborStartOffset(i); j < GetNeighborEndOffset(i);
+         j++) {
+      if (rank[GetNeighbor(j)] > rank[i]) num_children++;
+      if (rank[GetNeighbor(j)] < rank[i]) num_parents++;
     }
-    result->start_offset_by_label_[i * (max_label_ + 1) + l].second =
-        result->start_offset_[i + 1];
-
-    // update adj_array_
-    std::copy(neighbors.begin(), neighbors.end(),
-              result->adj_array_.begin() + result->start_offset_[i]);
-  }  
-  
-  // fill par_array_
-  result->start_offset_par_.resize(num_vertices_ + 1);
-  result->par_array_.resize(num_edges_);
-  for (size_t i = 0; i < par_list.size(); i++) {
-    auto &neighbors = par_list[i];
-
-    // fill start_offset_par_
-    result->start_offset_par_[i+1]
-      = result->start_offset_par_[i] + neighbors.size();
-
-    // if no outgoing edge, done
-    if(!neighbors.size()) continue;
-
-    // update par_array_
-    std::copy(neighbors.begin(), neighbors.end(),
-              result->par_array_.begin() + result->start_offset_par_[i]);
-  }  
-
-  // /* CORRECTNESS CHECK */
-  // assert(count_edges == num_edges_ && "Some edges are lost");
-  // assert(isDAG(root, *result) && "Not a DAG");
-
-  // for (size_t i = 0; i < num_vertices_; i++) {
-  //   for (Label l = 0; l <= max_label_; l++) {
-  //     if (result->GetNeighborStartOffset(i, l) == 0)
-  //       continue;
-  //     assert(result->GetNeighborStartOffset(i) <= result->GetNeighborStartOffset(i, l));
-  //     assert(result->GetNeighborEndOffset(i) >= result->GetNeighborEndOffset(i, l));
-
-  //     for (size_t idx = result->GetNeighborStartOffset(i, l); idx < result->GetNeighborEndOffset(i, l); idx++) {
-  //       assert(result->GetLabel(result->adj_array_[idx]) == l);
-  //     }
-  //   }
-  // }
-
-  // for (size_t v1 = 0; v1 < num_vertices_; v1++) {
-  //   for (size_t v2 = v1; v2 < num_vertices_; v2++) {
-  //     if (result->IsChild(v1, v2))
-  //       assert(result->IsParent(v2, v1));
-  //     if (result->IsParent(v1, v2))
-  //       assert(result->IsChild(v2, v1));
-  //   }
-  // }
-
-  return result;  
+    result->start_offset_[i + 1] = result->start_offset_[i] + num_children;
+    result->start_offset_par_[i + 1] =
+        result->start_offset_par_[i] + num_parents;
+  }
+
+  result->adj_array_.resize(result->start_offset_[num_vertices_]);
+  result->par_array_.resize(result->start_offset_par_[num_vertices_]);
+  for (size_t i = 0; i < num_vertices_; i++) {
+    size_t child = result->start_offset_[i];
+    size_t parent = result->start_offset_par_[i];
+    for (size_t j = GetNeighborStartOffset(i); j < GetNeighborEndOffset(i);
+         j++) {
+      Vertex n = GetNeighbor(j);
+      if (rank[n] > rank[i]) result->adj_array_[child++] = n;
+      if (rank[n] < rank[i]) result->par_array_[parent++] = n;
+    }
+  }
+  result->BuildLabelRuns(1);
+
+  result->layer_ = std::move(layer);
+  result->num_layers_ = 0;
+  for (Vertex v : order)
+    result->num_layers_ = std::max(result->num_layers_, result->layer_[v] + 1);
+
+  return result;
+}
+
+/**
+ * @brief Returns the vertices of a DAG built by BuildDAG in topological order
+ * (parents before children).
+ *
+ * @return std::vector<Vertex>
+ */
+std::vector<Vertex> Graph::GetTopologicalOrder() const {
+  std::vector<size_t> in_degree(num_vertices_);
+  std::vector<Vertex> order;
+  order.reserve(num_vertices_);
+
+  for (size_t u = 0; u < num_vertices_; ++u) {
+    in_degree[u] = GetParentEndOffset(u) - GetParentStartOffset(u);
+    if (in_degree[u] == 0) order.push_back(u);
+  }
+
+  for (size_t i = 0; i < order.size(); ++i) {
+    Vertex u = order[i];
+    for (size_t j = GetNeighborStartOffset(u); j < GetNeighborEndOffset(u);
+         ++j) {
+      Vertex c = GetNeighbor(j);
+      if (--in_degree[c] == 0) order.push_back(c);
+    }
+  }
+
+  return order;
+}
+
+namespace {
+const char kSnapshotMagic[8] = {'G', 'P', 'M', 'C', 'S', 'R', '0', '1'};
+const uint32_t kSnapshotVersion = 3;
+
+/*
+ * Layout of a data graph snapshot. Every array is stored at an 8-byte aligned
+ * offset from the beginning of the file, so that the mapped file can be used
+ * in place.
+ */
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t graph_id;
+  uint64_t num_vertices;
+  uint64_t num_edges;
+  uint64_t num_labels;
+  int32_t max_label;
+  int32_t reserved;
+  uint64_t num_transferred_labels;
+
+  uint64_t label_frequency_offset;
+  uint64_t start_offset_offset;
+  uint64_t num_label_runs;
+  uint64_t label_run_offset_offset;
+  uint64_t label_runs_offset;
+  uint64_t label_offset;
+  uint64_t adj_array_offset;
+  uint64_t transferred_label_offset;
+  // 0 unless the graph was reordered, num_vertices otherwise
+  uint64_t num_original_ids;
+  uint64_t original_id_offset;
+  uint64_t vertex_id_offset;
+  uint64_t file_size;
+};
+}  // namespace
+
+/**
+ * @brief Returns true if the file starts with the snapshot magic bytes.
+ *
+ * @param filename path of a graph file.
+ * @return bool
+ */
+bool Graph::IsSnapshot(const std::string &filename) {
+  std::ifstream fin(filename, std::ios::binary);
+  char magic[sizeof(kSnapshotMagic)];
+
+  if (!fin.read(magic, sizeof(magic))) return false;
+  return std::memcmp(magic, kSnapshotMagic, sizeof(magic)) == 0;
+}
+
+/**
+ * @brief Writes the CSR arrays, the label remapping table and the original
+ * vertex ids of this data graph to a binary snapshot that the constructor can later map in place.
+ *
+ * @param filename path of the snapshot file.
+ */
+void Graph::SaveSnapshot(const std::string &filename) const {
+  SnapshotHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+  header.version = kSnapshotVersion;
+  header.graph_id = graph_id_;
+  header.num_vertices = num_vertices_;
+  header.num_edges = num_edges_;
+  header.num_labels = num_labels_;
+  header.max_label = max_label_;
+  header.num_transferred_labels = label_map_.size();
+  header.num_label_runs = label_runs_.size();
+  header.num_original_ids = original_id_.size();
+
+  uint64_t offset = AlignUp(sizeof(header));
+  header.label_frequency_offset = offset;
+  offset = AlignUp(offset + label_frequency_.size() * sizeof(size_t));
+  header.start_offset_offset = offset;
+  offset = AlignUp(offset + start_offset_.size() * sizeof(size_t));
+  header.label_run_offset_offset = offset;
+  offset = AlignUp(offset + label_run_offset_.size() * sizeof(size_t));
+  header.label_runs_offset = offset;
+  offset = AlignUp(offset + label_runs_.size() * sizeof(LabelRun));
+  header.label_offset = offset;
+  offset = AlignUp(offset + label_.size() * sizeof(Label));
+  header.adj_array_offset = offset;
+  offset = AlignUp(offset + adj_array_.size() * sizeof(Vertex));
+  header.transferred_label_offset = offset;
+  offset = AlignUp(offset + label_map_.size() * sizeof(Label));
+  header.original_id_offset = offset;
+  offset = AlignUp(offset + original_id_.size() * sizeof(Vertex));
+  header.vertex_id_offset = offset;
+  offset = AlignUp(offset + vertex_id_.size() * sizeof(Vertex));
+  header.file_size = offset;
+
+  std::ofstream fout(TempFileName(filename),
+                     std::ios::binary | std::ios::trunc);
+
+  if (!fout.is_open())
+    throw std::runtime_error("Cannot write snapshot " + filename + "!");
+
+  fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  WriteArray(fout, label_frequency_, header.label_frequency_offset);
+  WriteArray(fout, start_offset_, header.start_offset_offset);
+  WriteArray(fout, label_run_offset_, header.label_run_offset_offset);
+  WriteArray(fout, label_runs_, header.label_runs_offset);
+  WriteArray(fout, label_, header.label_offset);
+  WriteArray(fout, adj_array_, header.adj_array_offset);
+  WriteArray(fout, label_map_, header.transferred_label_offset);
+  WriteArray(fout, original_id_, header.original_id_offset);
+  WriteArray(fout, vertex_id_, header.vertex_id_offset);
+
+  // pad the last array so that the file size matches the header
+  fout.seekp(header.file_size - 1);
+  fout.put('\0');
+
+  CommitFile(fout, filename);
+}
+
+/**
+ * @brief Maps a snapshot written by SaveSnapshot. No array is parsed or
+ * copied; the buffers point directly into the mapping.
+ *
+ * @param filename path of the snapshot file.
+ */
+void Graph::LoadSnapshot(const std::string &filename) {
+  snapshot_ = std::make_shared<MappedFile>(filename);
+
+  if (snapshot_->GetSize() < sizeof(SnapshotHeader))
+    throw std::runtime_error("Snapshot " + filename + " is truncated!");
+
+  SnapshotHeader header;
+  std::memcpy(&header, snapshot_->GetData(), sizeof(header));
+
+  if (header.version != kSnapshotVersion ||
+      header.file_size != snapshot_->GetSize())
+    throw std::runtime_error("Snapshot " + filename +
+                             " has an unsupported version!");
+
+  graph_id_ = header.graph_id;
+  num_vertices_ = header.num_vertices;
+  num_edges_ = header.num_edges;
+  num_labels_ = header.num_labels;
+  max_label_ = header.max_label;
+
+  const MappedFile &file = *snapshot_;
+  BorrowArray(file, header.label_frequency_offset, max_label_ + 1,
+              label_frequency_);
+  BorrowArray(file, header.start_offset_offset, num_vertices_ + 1,
+              start_offset_);
+  BorrowArray(file, header.label_run_offset_offset, num_vertices_ + 1,
+              label_run_offset_);
+  BorrowArray(file, header.label_runs_offset, header.num_label_runs,
+              label_runs_);
+  BorrowArray(file, header.label_offset, num_vertices_, label_);
+  BorrowArray(file, header.adj_array_offset, num_edges_ * 2, adj_array_);
+  BorrowArray(file, header.transferred_label_offset,
+              header.num_transferred_labels, label_map_);
+  BorrowArray(file, header.original_id_offset, header.num_original_ids,
+              original_id_);
+  BorrowArray(file, header.vertex_id_offset, header.num_original_ids,
+              vertex_id_);
 }
 
 Graph::~Graph() {}
@@ -0,0 +1,220 @@
+/**
+ * @file intersection.cc
+ *
+ */
+
+#include "intersection.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define INTERSECTION_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+// above this size ratio, galloping beats merging
+const size_t kGallopingRatio = 32;
+
+struct MergeKernel {
+  IntersectKernel kernel;
+  const char *name;
+};
+
+#ifdef INTERSECTION_X86
+/*
+ * Shuffle masks that move the lanes selected by a 4-bit mask to the front,
+ * for _mm_shuffle_epi8.
+ */
+struct ShuffleTable4 {
+  ShuffleTable4() {
+    for (int mask = 0; mask < 16; ++mask) {
+      int k = 0;
+      for (int lane = 0; lane < 4; ++lane) {
+        if (!(mask >> lane & 1)) continue;
+        for (int b = 0; b < 4; ++b) bytes[mask][k * 4 + b] = lane * 4 + b;
+        ++k;
+      }
+      for (; k < 4; ++k)
+        for (int b = 0; b < 4; ++b) bytes[mask][k * 4 + b] = static_cast<char>(0x80);
+    }
+  }
+  alignas(16) char bytes[16][16];
+};
+
+/*
+ * Lane permutations that move the lanes selected by an 8-bit mask to the
+ * front, for _mm256_permutevar8x32_epi32.
+ */
+struct PermuteTable8 {
+  PermuteTable8() {
+    for (int mask = 0; mask < 256; ++mask) {
+      int k = 0;
+      for (int lane = 0; lane < 8; ++lane)
+        if (mask >> lane & 1) lanes[mask][k++] = lane;
+      for (; k < 8; ++k) lanes[mask][k] = 0;
+    }
+  }
+  alignas(32) uint32_t lanes[256][8];
+};
+
+const ShuffleTable4 kShuffleTable4;
+const PermuteTable8 kPermuteTable8;
+
+/*
+ * Compares blocks of 4 elements of a against all rotations of blocks of 4
+ * elements of b, and keeps the elements of a that matched.
+ */
+__attribute__((target("sse4.1,ssse3,popcnt"))) size_t IntersectSSE(
+    const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+    uint32_t *out) {
+  size_t i = 0, j = 0, n = 0;
+
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+
+    __m128i cmp = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39))),
+        _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4e)),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93))));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(cmp));
+
+    __m128i shuffle = _mm_load_si128(
+        reinterpret_cast<const __m128i *>(kShuffleTable4.bytes[mask]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + n),
+                     _mm_shuffle_epi8(va, shuffle));
+    n += _mm_popcnt_u32(mask);
+
+    uint32_t a_max = a[i + 3], b_max = b[j + 3];
+    if (a_max <= b_max) i += 4;
+    if (b_max <= a_max) j += 4;
+  }
+
+  return n + IntersectMerge(a + i, na - i, b + j, nb - j, out + n);
+}
+
+/*
+ * The same with blocks of 8 elements and the 8 rotations of the b block.
+ */
+__attribute__((target("avx2,popcnt"))) size_t IntersectAVX2(
+    const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+    uint32_t *out) {
+  size_t i = 0, j = 0, n = 0;
+  const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+
+  while (i + 8 <= na && j + 8 <= nb) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+
+    __m256i cmp = _mm256_cmpeq_epi32(va, vb);
+    for (int r = 1; r < 8; ++r) {
+      vb = _mm256_permutevar8x32_epi32(vb, rotate);
+      cmp = _mm256_or_si256(cmp, _mm256_cmpeq_epi32(va, vb));
+    }
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(cmp));
+
+    __m256i permute = _mm256_load_si256(
+        reinterpret_cast<const __m256i *>(kPermuteTable8.lanes[mask]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + n),
+                        _mm256_permutevar8x32_epi32(va, permute));
+    n += _mm_popcnt_u32(mask);
+
+    uint32_t a_max = a[i + 7], b_max = b[j + 7];
+    if (a_max <= b_max) i += 8;
+    if (b_max <= a_max) j += 8;
+  }
+
+  return n + IntersectSSE(a + i, na - i, b + j, nb - j, out + n);
+}
+#endif
+
+MergeKernel SelectMergeKernel() {
+#ifdef INTERSECTION_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    return {IntersectAVX2, "avx2"};
+  if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3") &&
+      __builtin_cpu_supports("popcnt"))
+    return {IntersectSSE, "sse4"};
+#endif
+  return {IntersectMerge, "scalar"};
+}
+
+const MergeKernel &GetSelectedKernel() {
+  static const MergeKernel kernel = SelectMergeKernel();
+  return kernel;
+}
+}  // namespace
+
+/**
+ * @brief Scalar merge of two sorted arrays.
+ */
+size_t IntersectMerge(const uint32_t *a, size_t na, const uint32_t *b,
+                      size_t nb, uint32_t *out) {
+  size_t i = 0, j = 0, n = 0;
+  while (i < na && j < nb) {
+    uint32_t x = a[i], y = b[j];
+    out[n] = x;
+    n += (x == y);
+    i += (x <= y);
+    j += (y <= x);
+  }
+  return n;
+}
+
+/**
+ * @brief Looks up every element of the shorter array in the longer one with
+ * an exponential search that resumes where the previous one ended.
+ */
+size_t IntersectGalloping(const uint32_t *a, size_t na, const uint32_t *b,
+                          size_t nb, uint32_t *out) {
+  if (na > nb) return IntersectGalloping(b, nb, a, na, out);
+
+  size_t n = 0;
+  const uint32_t *lo = b;
+  const uint32_t *end = b + nb;
+
+  for (size_t i = 0; i < na && lo < end; ++i) {
+    uint32_t x = a[i];
+    size_t step = 1;
+    const uint32_t *hi = lo;
+    while (hi < end && *hi < x) {
+      lo = hi + 1;
+      hi += step;
+      step <<= 1;
+    }
+    lo = std::lower_bound(lo, std::min(hi + 1, end), x);
+    if (lo < end && *lo == x) out[n++] = x;
+  }
+  return n;
+}
+
+/**
+ * @brief Returns the fastest merge kernel the CPU supports (AVX2, SSE4.1 or
+ * scalar), chosen once at the first call.
+ *
+ * @return IntersectKernel
+ */
+IntersectKernel GetMergeKernel() { return GetSelectedKernel().kernel; }
+
+/**
+ * @brief Returns the name of the kernel returned by GetMergeKernel.
+ *
+ * @return const char*
+ */
+const char *GetMergeKernelName() { return GetSelectedKernel().name; }
+
+/**
+ * @brief Intersects with galloping when one array is much longer than the
+ * other, and with the merge kernel of the CPU otherwise.
+ */
+size_t Intersect(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                 uint32_t *out) {
+  if (na == 0 || nb == 0) return 0;
+  if (na > nb * kGallopingRatio || nb > na * kGallopingRatio)
+    return IntersectGalloping(a, na, b, nb, out);
+  static const IntersectKernel merge = GetMergeKernel();
+  return merge(a, na, b, nb, out);
+}
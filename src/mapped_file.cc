@@ -0,0 +1,42 @@
+/**
+ * @file mapped_file.cc
+ *
+ */
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &filename)
+    : data_(nullptr), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+
+  if (fd < 0) throw std::runtime_error("File " + filename + " not found!");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot stat " + filename + "!");
+  }
+  size_ = static_cast<size_t>(st.st_size);
+
+  if (size_ > 0) {
+    // MAP_SHARED lets every process that maps the same file share the pages
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Cannot map " + filename + "!");
+    }
+    data_ = static_cast<const char *>(addr);
+  }
+
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) munmap(const_cast<char *>(data_), size_);
+}
@@ -0,0 +1,147 @@
+/**
+ * @file matching_order.cc
+ *
+ */
+
+#include "matching_order.h"
+
+MatchingOrder::MatchingOrder(const Graph &dag, const CandidateSet &cs,
+                             const CandidateSpace &space,
+                             OrderStrategy strategy, bool postpone_leaves)
+    : strategy_(strategy) {
+  BuildStaticOrder(dag, cs);
+  postponed_.assign(dag.GetNumVertices(), 0);
+  if (postpone_leaves) {
+    for (size_t u = 0; u < dag.GetNumVertices(); ++u)
+      postponed_[u] = is_leaf_[u] && static_cast<Vertex>(u) != dag.GetRoot();
+  }
+  if (strategy_ == OrderStrategy::kPathSize ||
+      strategy_ == OrderStrategy::kHybrid)
+    BuildWeights(dag, cs, space);
+}
+
+MatchingOrder::~MatchingOrder() {}
+
+/**
+ * @brief Returns the priority of the extendable query vertex u.
+ *
+ * @param u query vertex whose parents are all matched.
+ * @param candidates positions of its extendable candidates.
+ * @param n number of extendable candidates.
+ * @return OrderKey
+ */
+OrderKey MatchingOrder::GetKey(Vertex u, const uint32_t *candidates,
+                               size_t n) const {
+  OrderKey key = {0, 0, static_cast<size_t>(u)};
+
+  switch (strategy_) {
+    case OrderStrategy::kCandidateSize:
+      key.cost = n;
+      break;
+    case OrderStrategy::kStatic:
+      key.tie = rank_[u];
+      break;
+    case OrderStrategy::kPathSize:
+    case OrderStrategy::kHybrid:
+      for (size_t k = 0; k < n; ++k) key.cost += GetWeight(u, candidates[k]);
+      if (strategy_ == OrderStrategy::kHybrid) {
+        // near-forced vertices first; leaves prune nothing below them
+        key.group = n <= 1 ? 0 : is_leaf_[u] ? 2 : 1;
+        key.tie = rank_[u];
+      }
+      break;
+  }
+  return key;
+}
+
+void MatchingOrder::BuildStaticOrder(const Graph &dag,
+                                     const CandidateSet &cs) {
+  size_t num_vertices = dag.GetNumVertices();
+  rank_.assign(num_vertices, num_vertices);
+  is_leaf_.resize(num_vertices);
+  static_order_.clear();
+
+  // query neighbors of u are its DAG children and parents
+  auto for_each_neighbor = [&dag](Vertex u, const std::function<void(Vertex)>
+                                                &f) {
+    for (size_t i = dag.GetNeighborStartOffset(u);
+         i < dag.GetNeighborEndOffset(u); ++i)
+      f(dag.GetNeighbor(i));
+    for (size_t i = dag.GetParentStartOffset(u); i < dag.GetParentEndOffset(u);
+         ++i)
+      f(dag.GetParent(i));
+  };
+
+  // ordered neighbors, neighbors adjacent to an ordered vertex, unordered
+  // parents
+  std::vector<size_t> num_ordered(num_vertices, 0);
+  std::vector<size_t> num_frontier(num_vertices, 0);
+  std::vector<char> in_frontier(num_vertices, 0);
+  std::vector<size_t> num_waiting(num_vertices);
+  for (size_t u = 0; u < num_vertices; ++u) {
+    num_waiting[u] = dag.GetParentEndOffset(u) - dag.GetParentStartOffset(u);
+    is_leaf_[u] = dag.GetNeighborStartOffset(u) == dag.GetNeighborEndOffset(u);
+  }
+
+  Vertex next = dag.GetRoot();
+  while (next >= 0) {
+    Vertex u = next;
+    rank_[u] = static_order_.size();
+    static_order_.push_back(u);
+
+    for_each_neighbor(u, [&](Vertex w) {
+      ++num_ordered[w];
+      if (!in_frontier[w]) {
+        in_frontier[w] = true;
+        for_each_neighbor(w, [&](Vertex x) { ++num_frontier[x]; });
+      }
+    });
+    for (size_t i = dag.GetNeighborStartOffset(u);
+         i < dag.GetNeighborEndOffset(u); ++i)
+      --num_waiting[dag.GetNeighbor(i)];
+
+    next = -1;
+    for (size_t w = 0; w < num_vertices; ++w) {
+      if (rank_[w] != num_vertices || num_waiting[w] != 0) continue;
+      if (next < 0 || num_ordered[w] > num_ordered[next] ||
+          (num_ordered[w] == num_ordered[next] &&
+           (num_frontier[w] > num_frontier[next] ||
+            (num_frontier[w] == num_frontier[next] &&
+             cs.GetCandidateSize(w) < cs.GetCandidateSize(next)))))
+        next = w;
+    }
+  }
+}
+
+void MatchingOrder::BuildWeights(const Graph &dag, const CandidateSet &cs,
+                                 const CandidateSpace &space) {
+  size_t num_vertices = dag.GetNumVertices();
+  weight_offset_.assign(num_vertices + 1, 0);
+  for (size_t u = 0; u < num_vertices; ++u)
+    weight_offset_[u + 1] = weight_offset_[u] + cs.GetCandidateSize(u);
+  weights_.assign(weight_offset_[num_vertices], 1);
+
+  // children before parents
+  std::vector<Vertex> order = dag.GetTopologicalOrder();
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    Vertex u = *it;
+    bool has_tree_child = false;
+
+    for (size_t ci = dag.GetNeighborStartOffset(u);
+         ci < dag.GetNeighborEndOffset(u); ++ci) {
+      Vertex c = dag.GetNeighbor(ci);
+      size_t e = dag.GetParentStartOffset(c);
+      if (dag.GetParentEndOffset(c) != e + 1) continue;
+
+      for (size_t i = 0; i < cs.GetCandidateSize(u); ++i) {
+        double sum = 0;
+        for (const uint32_t *j = space.GetAdjacentBegin(e, i);
+             j != space.GetAdjacentEnd(e, i); ++j)
+          sum += GetWeight(c, *j);
+        double &weight = weights_[weight_offset_[u] + i];
+        weight = has_tree_child ? std::min(weight, sum) : sum;
+      }
+      has_tree_child = true;
+    }
+  }
+}
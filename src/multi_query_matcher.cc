@@ -0,0 +1,422 @@
+/**
+ * @file multi_query_matcher.cc
+ *
+ */
+
+#include "multi_query_matcher.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+
+namespace {
+// how many visited data vertices a thread matches between two checks of the
+// time limit and the cancellation token
+const size_t kStopCheckInterval = 1 << 12;
+}  // namespace
+
+/**
+ * @param data data graph.
+ * @param options num_threads, time_limit and cancellation are used.
+ */
+MultiQueryMatcher::MultiQueryMatcher(const Graph &data,
+                                     const SearchOptions &options)
+    : data_(data),
+      options_(options),
+      nodes_(1),
+      max_depth_(0),
+      callback_(nullptr),
+      stop_(false),
+      interrupted_(false) {}
+MultiQueryMatcher::~MultiQueryMatcher() {}
+
+/**
+ * @brief Adds a query graph to the batch. A query with an empty candidate
+ * set has no embedding and is left out of the search.
+ *
+ * @param query_filename text query graph file.
+ * @param candidate_filename candidate set file, or empty to compute the
+ * candidate set in-process.
+ * @return size_t index of the query in the results.
+ */
+size_t MultiQueryMatcher::AddQuery(const std::string &query_filename,
+                                   const std::string &candidate_filename) {
+  Query query;
+  query.graph.reset(new Graph(query_filename, data_));
+  query.cs.reset(candidate_filename.empty()
+                     ? new CandidateSet(data_, *query.graph)
+                     : new CandidateSet(candidate_filename, data_));
+  if (!candidate_filename.empty()) query.cs->CheckFits(data_, *query.graph);
+  query.cs->BuildMembership(data_.GetNumVertices());
+  queries_.push_back(std::move(query));
+
+  size_t index = queries_.size() - 1;
+  const CandidateSet &cs = *queries_[index].cs;
+  for (size_t u = 0; u < queries_[index].graph->GetNumVertices(); ++u)
+    if (cs.GetCandidateSize(u) == 0) return index;
+  Insert(index);
+  return index;
+}
+
+/**
+ * @brief Adds the path of a query to the trie: along the existing pattern
+ * vertices as far as possible, then as a new branch.
+ *
+ * @param index index of the query.
+ */
+void MultiQueryMatcher::Insert(size_t index) {
+  Query &query = queries_[index];
+  const Graph &q = *query.graph;
+  const CandidateSet &cs = *query.cs;
+  size_t n = q.GetNumVertices();
+  if (n == 0) return;
+  max_depth_ = std::max(max_depth_, n);
+
+  std::vector<int> depth(n, -1);
+  auto matched_neighbors = [&](Vertex u) {
+    std::vector<uint32_t> result;
+    for (size_t i = q.GetNeighborStartOffset(u); i < q.GetNeighborEndOffset(u);
+         ++i)
+      if (depth[q.GetNeighbor(i)] >= 0)
+        result.push_back(depth[q.GetNeighbor(i)]);
+    std::sort(result.begin(), result.end());
+    return result;
+  };
+  auto append = [&](size_t node, Vertex u, std::vector<uint32_t> extra) {
+    depth[u] = query.order.size();
+    query.order.push_back(u);
+    nodes_[node].members.push_back(
+        Member{index, u, std::move(extra), query.order.size() == n});
+  };
+
+  // follow the pattern vertex and query vertex that lose the fewest backward
+  // edges, then add the fewest of their own, then have the fewest candidates
+  size_t node = 0;
+  while (query.order.size() < n) {
+    size_t best_node = 0;
+    Vertex best = -1;
+    size_t best_lost = 0, best_extra = 0;
+    for (size_t c : nodes_[node].children) {
+      const Node &child = nodes_[c];
+      for (size_t u = 0; u < n; ++u) {
+        if (depth[u] >= 0 || q.GetLabel(u) != child.label) continue;
+        std::vector<uint32_t> neighbors = matched_neighbors(u);
+        std::vector<uint32_t> common;
+        std::set_intersection(child.backward.begin(), child.backward.end(),
+                              neighbors.begin(), neighbors.end(),
+                              std::back_inserter(common));
+        if (neighbors.empty() != child.backward.empty() ||
+            (!neighbors.empty() && common.empty()))
+          continue;
+
+        size_t lost = child.backward.size() - common.size();
+        size_t extra = neighbors.size() - common.size();
+        if (best < 0 || lost < best_lost ||
+            (lost == best_lost &&
+             (extra < best_extra ||
+              (extra == best_extra &&
+               cs.GetCandidateSize(u) < cs.GetCandidateSize(best))))) {
+          best_node = c;
+          best = u;
+          best_lost = lost;
+          best_extra = extra;
+        }
+      }
+    }
+    if (best < 0) break;
+
+    Node &child = nodes_[best_node];
+    std::vector<uint32_t> neighbors = matched_neighbors(best);
+    std::vector<uint32_t> shared, extra;
+    std::set_intersection(child.backward.begin(), child.backward.end(),
+                          neighbors.begin(), neighbors.end(),
+                          std::back_inserter(shared));
+    std::set_difference(neighbors.begin(), neighbors.end(), shared.begin(),
+                        shared.end(), std::back_inserter(extra));
+    if (shared.size() < child.backward.size()) {
+      // the other members check the backward edges best does not have
+      std::vector<uint32_t> lost;
+      std::set_difference(child.backward.begin(), child.backward.end(),
+                          shared.begin(), shared.end(),
+                          std::back_inserter(lost));
+      for (auto &member : child.members) {
+        member.extra.insert(member.extra.end(), lost.begin(), lost.end());
+        std::sort(member.extra.begin(), member.extra.end());
+      }
+      child.backward = shared;
+    }
+    append(best_node, best, std::move(extra));
+    node = best_node;
+  }
+  if (query.order.size() == n) return;
+
+  // a new branch for the rest: leaves last, since they prune nothing, and
+  // otherwise the vertex with the fewest candidates per candidate of a
+  // matched neighbor
+  std::vector<double> branching(n * n, 0);
+  for (size_t u = 0; u < n; ++u) {
+    for (size_t i = q.GetNeighborStartOffset(u); i < q.GetNeighborEndOffset(u);
+         ++i) {
+      Vertex p = q.GetNeighbor(i);
+      size_t num_edges = 0;
+      for (size_t k = 0; k < cs.GetCandidateSize(p); ++k) {
+        Vertex v = cs.GetCandidate(p, k);
+        for (size_t j = data_.GetNeighborStartOffset(v, q.GetLabel(u));
+             j < data_.GetNeighborEndOffset(v, q.GetLabel(u)); ++j)
+          if (cs.IsCandidate(u, data_.GetNeighbor(j))) ++num_edges;
+      }
+      branching[u * n + p] =
+          static_cast<double>(num_edges) / cs.GetCandidateSize(p);
+    }
+  }
+  while (query.order.size() < n) {
+    Vertex best = -1;
+    auto key = [&](Vertex u) {
+      double cost = cs.GetCandidateSize(u);
+      bool connected = query.order.empty();
+      for (size_t i = q.GetNeighborStartOffset(u);
+           i < q.GetNeighborEndOffset(u); ++i) {
+        Vertex p = q.GetNeighbor(i);
+        if (depth[p] < 0) continue;
+        connected = true;
+        cost = std::min(cost, branching[u * n + p]);
+      }
+      bool leaf = q.GetDegree(u) <= 1 && n > 2;
+      return std::make_tuple(!connected, leaf, cost);
+    };
+    for (size_t u = 0; u < n; ++u)
+      if (depth[u] < 0 && (best < 0 || key(u) < key(best))) best = u;
+
+    Node child;
+    child.label = q.GetLabel(best);
+    child.backward = matched_neighbors(best);
+    nodes_.push_back(std::move(child));
+    nodes_[node].children.push_back(nodes_.size() - 1);
+    node = nodes_.size() - 1;
+    append(node, best, std::vector<uint32_t>());
+  }
+}
+
+/**
+ * @brief Returns the number of embeddings of every query, by index.
+ *
+ * @return std::vector<size_t>
+ */
+std::vector<size_t> MultiQueryMatcher::CountMatches() {
+  return Search(nullptr);
+}
+
+/**
+ * @brief Passes every embedding of every query to the callback. With several
+ * threads the calls are serialized, so the callback need not be thread-safe.
+ *
+ * @return std::vector<size_t> the number of embeddings of every query.
+ */
+std::vector<size_t> MultiQueryMatcher::FindMatches(
+    const BatchCallback &callback) {
+  return Search(&callback);
+}
+
+/**
+ * @brief Returns true if the last search was stopped by its time limit or
+ * its cancellation token before it was complete.
+ *
+ * @return bool
+ */
+bool MultiQueryMatcher::IsInterrupted() const { return interrupted_; }
+
+/**
+ * @brief Searches the trie on options.num_threads threads, which take the
+ * candidates of the first pattern vertices one at a time.
+ *
+ * @param callback receives the embeddings, or nullptr to count them.
+ * @return std::vector<size_t> the number of embeddings of every query.
+ */
+std::vector<size_t> MultiQueryMatcher::Search(const BatchCallback *callback) {
+  size_t num_queries = queries_.size();
+
+  // pattern vertices without backward edges are matched to any candidate
+  // of a member
+  for (auto &node : nodes_) {
+    if (!node.backward.empty()) continue;
+    node.roots.clear();
+    for (auto &member : node.members) {
+      const CandidateSet &cs = *queries_[member.query].cs;
+      node.roots.insert(node.roots.end(), cs.GetCandidates(member.u),
+                        cs.GetCandidates(member.u) +
+                            cs.GetCandidateSize(member.u));
+    }
+    std::sort(node.roots.begin(), node.roots.end());
+    node.roots.erase(std::unique(node.roots.begin(), node.roots.end()),
+                     node.roots.end());
+  }
+
+  std::vector<std::pair<size_t, Vertex>> tasks;
+  for (size_t c : nodes_[0].children)
+    for (Vertex v : nodes_[c].roots) tasks.emplace_back(c, v);
+
+  callback_ = callback;
+  stop_ = false;
+  interrupted_ = false;
+  deadline_ = std::chrono::steady_clock::now() +
+              std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double>(options_.time_limit));
+
+  size_t num_threads = GetNumThreads(options_.num_threads);
+  std::vector<State> states(num_threads);
+  std::atomic<size_t> next_task(0);
+  ParallelFor(0, num_threads, num_threads, [&](size_t, size_t, size_t t) {
+    State &state = states[t];
+    state.mapped.resize(max_depth_);
+    state.used.assign(data_.GetNumVertices(), 0);
+    state.alive.assign((max_depth_ + 1) * num_queries, 0);
+    std::fill(state.alive.begin(), state.alive.begin() + num_queries, 1);
+    state.num_matches.assign(num_queries, 0);
+
+    size_t i;
+    while (!stop_ && (i = next_task++) < tasks.size())
+      Visit(state, tasks[i].first, 0, tasks[i].second);
+  });
+
+  std::vector<size_t> num_matches(num_queries, 0);
+  for (auto &state : states)
+    for (size_t q = 0; q < state.num_matches.size(); ++q)
+      num_matches[q] += state.num_matches[q];
+  callback_ = nullptr;
+  return num_matches;
+}
+
+/**
+ * @brief Matches the children of a pattern vertex whose path is matched.
+ *
+ * @param state
+ * @param node the pattern vertex.
+ * @param depth number of matched pattern vertices.
+ */
+void MultiQueryMatcher::Extend(State &state, size_t node, size_t depth) {
+  const char *alive = &state.alive[depth * queries_.size()];
+  for (size_t c : nodes_[node].children) {
+    const Node &child = nodes_[c];
+    bool any = false;
+    for (auto &member : child.members) any = any || alive[member.query];
+    if (!any) continue;
+
+    // when counting, the last vertices of the queries are only counted
+    bool count = callback_ == nullptr && child.children.empty();
+    auto match = [&](Vertex v) {
+      if (!count) {
+        Visit(state, c, depth, v);
+        return;
+      }
+      if (state.used[v]) return;
+      for (auto &member : child.members) {
+        bool ok = alive[member.query] &&
+                  queries_[member.query].cs->IsCandidate(member.u, v);
+        for (size_t k = 0; k < member.extra.size() && ok; ++k)
+          ok = data_.IsNeighbor(state.mapped[member.extra[k]], v);
+        if (ok) ++state.num_matches[member.query];
+      }
+    };
+
+    if (child.backward.empty()) {
+      for (Vertex v : child.roots) match(v);
+      continue;
+    }
+
+    // scan the fewest neighbors with the label among the matched neighbors
+    size_t best = 0;
+    size_t best_size = SIZE_MAX;
+    for (size_t k = 0; k < child.backward.size(); ++k) {
+      Vertex w = state.mapped[child.backward[k]];
+      size_t size = data_.GetNeighborEndOffset(w, child.label) -
+                    data_.GetNeighborStartOffset(w, child.label);
+      if (size < best_size) {
+        best = k;
+        best_size = size;
+      }
+    }
+    Vertex w = state.mapped[child.backward[best]];
+    size_t begin = data_.GetNeighborStartOffset(w, child.label);
+    for (size_t i = begin; i < begin + best_size; ++i) {
+      Vertex v = data_.GetNeighbor(i);
+      bool adjacent = true;
+      for (size_t k = 0; k < child.backward.size() && adjacent; ++k)
+        adjacent =
+            k == best || data_.IsNeighbor(state.mapped[child.backward[k]], v);
+      if (adjacent) match(v);
+    }
+  }
+}
+
+/**
+ * @brief Matches a pattern vertex to v, which is adjacent to the data
+ * vertices of its backward edges, for the members that stay alive, reports
+ * the queries it completes and extends the path.
+ *
+ * @param state
+ * @param node the pattern vertex.
+ * @param depth its depth.
+ * @param v
+ */
+void MultiQueryMatcher::Visit(State &state, size_t node, size_t depth,
+                              Vertex v) {
+  if (stop_ || state.used[v]) return;
+  if (++state.num_visits % kStopCheckInterval == 0 && CheckStop()) return;
+
+  const Node &pattern = nodes_[node];
+  size_t num_queries = queries_.size();
+  const char *parent_alive = &state.alive[depth * num_queries];
+  char *alive = &state.alive[(depth + 1) * num_queries];
+  bool any = false;
+  for (auto &member : pattern.members) {
+    bool ok = parent_alive[member.query] &&
+              queries_[member.query].cs->IsCandidate(member.u, v);
+    for (size_t k = 0; k < member.extra.size() && ok; ++k)
+      ok = data_.IsNeighbor(state.mapped[member.extra[k]], v);
+    alive[member.query] = ok;
+    any = any || ok;
+  }
+  if (!any) return;
+
+  state.mapped[depth] = v;
+  state.used[v] = 1;
+  for (auto &member : pattern.members)
+    if (member.last && alive[member.query]) Report(state, member.query);
+  Extend(state, node, depth + 1);
+  state.used[v] = 0;
+}
+
+/**
+ * @brief Counts the embedding of a query that the matched path completes,
+ * and passes it to the callback.
+ *
+ * @param state
+ * @param query
+ */
+void MultiQueryMatcher::Report(State &state, size_t query) {
+  ++state.num_matches[query];
+  if (callback_ == nullptr) return;
+
+  const std::vector<Vertex> &order = queries_[query].order;
+  state.embedding.resize(order.size());
+  for (size_t d = 0; d < order.size(); ++d)
+    state.embedding[order[d]] = data_.GetOriginalID(state.mapped[d]);
+  std::lock_guard<std::mutex> lock(callback_mutex_);
+  (*callback_)(query, state.embedding);
+}
+
+/**
+ * @brief Stops the search at the deadline or on cancellation.
+ *
+ * @return bool true if the search is stopped.
+ */
+bool MultiQueryMatcher::CheckStop() {
+  if ((options_.time_limit > 0 &&
+       std::chrono::steady_clock::now() >= deadline_) ||
+      (options_.cancellation && options_.cancellation->IsCancelled())) {
+    interrupted_ = true;
+    stop_ = true;
+  }
+  return stop_;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file output_sink.cc
+ *
+ */
+
+#include "output_sink.h"
+
+#include <cstring>
+
+namespace {
+// bytes of formatted embeddings a worker collects before writing them
+const size_t kOutputBufferSize = 1 << 18;
+// " -2147483648" is the longest text of one vertex
+const size_t kMaxVertexChars = 12;
+
+const char kBinaryMagic[8] = {'G', 'P', 'M', 'E', 'M', 'B', '0', '1'};
+
+// "00" "01" ... "99", to emit two digits per division
+const char kDigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*
+ * Writes the decimal digits of value ending right before end and returns the
+ * position of the first digit.
+ */
+inline char *FormatUnsigned(uint32_t value, char *end) {
+  while (value >= 100) {
+    uint32_t pair = (value % 100) * 2;
+    value /= 100;
+    *--end = kDigitPairs[pair + 1];
+    *--end = kDigitPairs[pair];
+  }
+  if (value >= 10) {
+    *--end = kDigitPairs[value * 2 + 1];
+    *--end = kDigitPairs[value * 2];
+  } else {
+    *--end = static_cast<char>('0' + value);
+  }
+  return end;
+}
+}  // namespace
+
+OutputSink::OutputSink(FILE *file, OutputFormat format,
+                       size_t num_query_vertices)
+    : file_(file), format_(format), num_query_vertices_(num_query_vertices) {}
+
+OutputSink::~OutputSink() { fflush(file_); }
+
+/**
+ * @brief Writes the "t n" line, or the binary header.
+ */
+void OutputSink::WriteHeader() {
+  if (format_ != OutputFormat::kBinary) {
+    char line[32];
+    int n = snprintf(line, sizeof(line), "t %lu\n",
+                     static_cast<unsigned long>(num_query_vertices_));
+    Write(line, n);
+    return;
+  }
+
+  char header[16];
+  uint32_t num_query_vertices = static_cast<uint32_t>(num_query_vertices_);
+  uint32_t reserved = 0;
+  std::memcpy(header, kBinaryMagic, sizeof(kBinaryMagic));
+  std::memcpy(header + 8, &num_query_vertices, sizeof(num_query_vertices));
+  std::memcpy(header + 12, &reserved, sizeof(reserved));
+  Write(header, sizeof(header));
+}
+
+/**
+ * @brief Writes a block of complete records.
+ *
+ * @param data
+ * @param size in bytes.
+ */
+void OutputSink::Write(const char *data, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fwrite(data, 1, size, file_);
+}
+
+OutputBuffer::OutputBuffer(OutputSink &sink)
+    : sink_(sink),
+      num_query_vertices_(sink.GetNumQueryVertices()),
+      binary_(sink.GetFormat() == OutputFormat::kBinary),
+      record_capacity_(binary_ ? num_query_vertices_ * sizeof(Vertex)
+                               : 2 + num_query_vertices_ * kMaxVertexChars),
+      buffer_(kOutputBufferSize + record_capacity_),
+      size_(0) {}
+
+OutputBuffer::~OutputBuffer() { Flush(); }
+
+/**
+ * @brief Hands the buffered records to the sink.
+ */
+void OutputBuffer::Flush() {
+  if (size_ == 0) return;
+  sink_.Write(buffer_.data(), size_);
+  size_ = 0;
+}
+
+/**
+ * @brief Writes " v" at out and returns the end of the text.
+ */
+inline char *OutputBuffer::AppendVertex(Vertex v, char *out) {
+  char digits[kMaxVertexChars];
+  char *digits_end = digits + sizeof(digits);
+  char *first =
+      FormatUnsigned(v < 0 ? 0U - static_cast<uint32_t>(v) : v, digits_end);
+  if (v < 0) *--first = '-';
+  *out++ = ' ';
+  std::memcpy(out, first, digits_end - first);
+  return out + (digits_end - first);
+}
+
+/**
+ * @brief Appends a group of embeddings in the factorized format.
+ *
+ * @param embedding data vertex of each query vertex, -1 for the leaves.
+ * @param leaves postponed query vertices.
+ * @param candidates data vertices of leaves[i] are candidates[offsets[i]]
+ * .. candidates[offsets[i + 1]].
+ * @param offsets
+ */
+void OutputBuffer::AppendFactorized(const Vertex *embedding,
+                                    const std::vector<Vertex> &leaves,
+                                    const Vertex *candidates,
+                                    const size_t *offsets) {
+  // records are written whole, however long
+  size_t capacity = 2 + num_query_vertices_ * kMaxVertexChars +
+                    leaves.size() * (3 + kMaxVertexChars) +
+                    offsets[leaves.size()] * kMaxVertexChars;
+  if (size_ + capacity > buffer_.size()) Flush();
+  if (capacity > buffer_.size()) buffer_.resize(capacity);
+
+  char *out = buffer_.data() + size_;
+  *out++ = 'f';
+  for (size_t i = 0; i < num_query_vertices_; ++i)
+    out = AppendVertex(embedding[i], out);
+  *out++ = '\n';
+  for (size_t i = 0; i < leaves.size(); ++i) {
+    *out++ = 'l';
+    out = AppendVertex(leaves[i], out);
+    for (size_t k = offsets[i]; k < offsets[i + 1]; ++k)
+      out = AppendVertex(candidates[k], out);
+    *out++ = '\n';
+  }
+
+  size_ = out - buffer_.data();
+}
+
+void OutputBuffer::AppendText(const Vertex *embedding) {
+  char *out = buffer_.data() + size_;
+
+  *out++ = 'a';
+  for (size_t i = 0; i < num_query_vertices_; ++i)
+    out = AppendVertex(embedding[i], out);
+  *out++ = '\n';
+
+  size_ = out - buffer_.data();
+}
@@ -0,0 +1,231 @@
+/**
+ * @file query_symmetry.cc
+ *
+ */
+
+#include "query_symmetry.h"
+
+#include <functional>
+#include <map>
+
+namespace {
+// candidates tried by all automorphism searches of one query before the
+// analysis gives up on the remaining steps
+const size_t kSearchBudget = 1 << 22;
+}  // namespace
+
+/**
+ * @brief Computes the stabilizer chain and the constraints of the query.
+ *
+ * @param query
+ * @param fixed_vertices 1 for the vertices every automorphism must fix
+ * (none if empty).
+ */
+QuerySymmetry::QuerySymmetry(const Graph &query,
+                             const std::vector<char> &fixed_vertices)
+    : query_(query),
+      num_vertices_(query.GetNumVertices()),
+      group_size_(1),
+      transversal_offset_(1, 0) {
+  std::vector<std::vector<Vertex>> bounds(num_vertices_);
+  std::vector<Vertex> fixed;
+  std::vector<Vertex> automorphism;
+  size_t budget = kSearchBudget;
+
+  for (size_t v = 0; v < fixed_vertices.size(); ++v)
+    if (fixed_vertices[v]) fixed.push_back(v);
+
+  for (size_t v = 0; v < num_vertices_; ++v) {
+    if (!fixed_vertices.empty() && fixed_vertices[v]) continue;
+    std::vector<uint32_t> colors = RefineColors(fixed);
+
+    // the identity comes first, so that Expand emits the canonical
+    // embedding first
+    std::vector<Vertex> orbit(1, v);
+    std::vector<Vertex> transversal;
+    for (size_t u = 0; u < num_vertices_; ++u) transversal.push_back(u);
+
+    for (size_t w = v + 1; w < num_vertices_ && budget != 0; ++w) {
+      // fixed vertices have colors of their own
+      if (colors[w] != colors[v]) continue;
+      if (FindAutomorphism(fixed, v, w, colors, &automorphism, &budget)) {
+        orbit.push_back(w);
+        transversal.insert(transversal.end(), automorphism.begin(),
+                           automorphism.end());
+      }
+    }
+    // an incomplete orbit would break symmetries that are not there
+    if (budget == 0 || group_size_ > SIZE_MAX / orbit.size()) break;
+
+    if (orbit.size() > 1) {
+      group_size_ *= orbit.size();
+      for (size_t k = 1; k < orbit.size(); ++k) {
+        bounds[v].push_back(orbit[k]);
+        bounds[orbit[k]].push_back(~static_cast<Vertex>(v));
+      }
+      transversal_.insert(transversal_.end(), transversal.begin(),
+                          transversal.end());
+      transversal_offset_.push_back(transversal_.size());
+    }
+    // every automorphism of the next steps fixes v
+    fixed.push_back(v);
+  }
+
+  bound_offset_.resize(num_vertices_ + 1, 0);
+  for (size_t u = 0; u < num_vertices_; ++u) {
+    bounds_.insert(bounds_.end(), bounds[u].begin(), bounds[u].end());
+    bound_offset_[u + 1] = bounds_.size();
+  }
+}
+
+QuerySymmetry::~QuerySymmetry() {}
+
+/**
+ * @brief Color refinement: starting from the labels, with every fixed vertex
+ * in a color of its own, splits colors by the multiset of the colors of the
+ * neighbors until they are stable. Vertices of different colors are in
+ * different orbits of the automorphisms that fix the fixed vertices.
+ *
+ * @param fixed
+ * @return std::vector<uint32_t> color of each query vertex.
+ */
+std::vector<uint32_t> QuerySymmetry::RefineColors(
+    const std::vector<Vertex> &fixed) const {
+  std::vector<uint32_t> colors(num_vertices_);
+  std::vector<char> is_fixed(num_vertices_, 0);
+  for (Vertex f : fixed) is_fixed[f] = 1;
+
+  std::map<std::vector<uint32_t>, uint32_t> ids;
+  for (size_t u = 0; u < num_vertices_; ++u) {
+    std::vector<uint32_t> key;
+    if (is_fixed[u])
+      key = {1, static_cast<uint32_t>(u)};
+    else
+      key = {0, static_cast<uint32_t>(query_.GetLabel(u))};
+    colors[u] = ids.emplace(key, ids.size()).first->second;
+  }
+
+  size_t num_colors = ids.size();
+  while (true) {
+    ids.clear();
+    std::vector<uint32_t> refined(num_vertices_);
+    for (size_t u = 0; u < num_vertices_; ++u) {
+      std::vector<uint32_t> key;
+      for (size_t i = query_.GetNeighborStartOffset(u);
+           i < query_.GetNeighborEndOffset(u); ++i)
+        key.push_back(colors[query_.GetNeighbor(i)]);
+      std::sort(key.begin(), key.end());
+      key.push_back(colors[u]);
+      refined[u] = ids.emplace(key, ids.size()).first->second;
+    }
+    colors.swap(refined);
+    if (ids.size() == num_colors) break;
+    num_colors = ids.size();
+  }
+  return colors;
+}
+
+/**
+ * @brief Looks for an automorphism that fixes the fixed vertices and maps v
+ * to w. Vertices are mapped in BFS order from v, each to a vertex of its
+ * color adjacent to the image of an already mapped neighbor, whose mapped
+ * neighbors are exactly the images of those of the vertex.
+ *
+ * @param fixed
+ * @param v
+ * @param w
+ * @param colors result of RefineColors(fixed).
+ * @param automorphism set to the images of the query vertices if found.
+ * @param budget candidates that may still be tried; the search fails once it
+ * reaches 0.
+ * @return true if an automorphism was found.
+ */
+bool QuerySymmetry::FindAutomorphism(const std::vector<Vertex> &fixed,
+                                     Vertex v, Vertex w,
+                                     const std::vector<uint32_t> &colors,
+                                     std::vector<Vertex> *automorphism,
+                                     size_t *budget) const {
+  std::vector<Vertex> &image = *automorphism;
+  image.assign(num_vertices_, -1);
+  std::vector<char> used(num_vertices_, 0);
+
+  auto is_consistent = [&](Vertex x, Vertex y) {
+    size_t mapped = 0;
+    for (size_t i = query_.GetNeighborStartOffset(x);
+         i < query_.GetNeighborEndOffset(x); ++i) {
+      Vertex z = image[query_.GetNeighbor(i)];
+      if (z < 0) continue;
+      if (!query_.IsNeighbor(y, z)) return false;
+      ++mapped;
+    }
+    for (size_t i = query_.GetNeighborStartOffset(y);
+         i < query_.GetNeighborEndOffset(y); ++i)
+      if (used[query_.GetNeighbor(i)]) --mapped;
+    return mapped == 0;
+  };
+
+  for (Vertex f : fixed) {
+    image[f] = f;
+    used[f] = 1;
+  }
+  if (!is_consistent(v, w)) return false;
+  image[v] = w;
+  used[w] = 1;
+
+  // BFS order of the other vertices from the mapped ones, each with a
+  // neighbor mapped before it (-1 if it starts another connected component)
+  std::vector<Vertex> order;
+  std::vector<Vertex> anchor(num_vertices_, -1);
+  std::vector<char> queued(num_vertices_, 0);
+  std::vector<Vertex> frontier(fixed);
+  frontier.push_back(v);
+  for (Vertex x : frontier) queued[x] = 1;
+  for (size_t start = 0;;) {
+    for (size_t f = 0; f < frontier.size(); ++f) {
+      Vertex x = frontier[f];
+      for (size_t i = query_.GetNeighborStartOffset(x);
+           i < query_.GetNeighborEndOffset(x); ++i) {
+        Vertex y = query_.GetNeighbor(i);
+        if (queued[y]) continue;
+        queued[y] = 1;
+        anchor[y] = x;
+        order.push_back(y);
+        frontier.push_back(y);
+      }
+    }
+    while (start < num_vertices_ && queued[start]) ++start;
+    if (start == num_vertices_) break;
+    queued[start] = 1;
+    order.push_back(start);
+    frontier.assign(1, start);
+  }
+
+  std::function<bool(size_t)> extend = [&](size_t k) {
+    if (k == order.size()) return true;
+    Vertex x = order[k];
+    auto try_image = [&](Vertex y) {
+      if (*budget == 0) return false;
+      --*budget;
+      if (used[y] || colors[y] != colors[x] || !is_consistent(x, y))
+        return false;
+      image[x] = y;
+      used[y] = 1;
+      if (extend(k + 1)) return true;
+      image[x] = -1;
+      used[y] = 0;
+      return false;
+    };
+
+    if (anchor[x] >= 0) {
+      Vertex a = image[anchor[x]];
+      for (size_t i = query_.GetNeighborStartOffset(a);
+           i < query_.GetNeighborEndOffset(a); ++i)
+        if (try_image(query_.GetNeighbor(i))) return true;
+    } else {
+      for (size_t y = 0; y < num_vertices_; ++y)
+        if (try_image(y)) return true;
+    }
+    return false;
+  };
+  return extend(0);
+}
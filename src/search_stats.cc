@@ -0,0 +1,63 @@
+/**
+ * @file search_stats.cc
+ *
+ */
+
+#include "search_stats.h"
+
+namespace {
+void WriteLevel(std::ostream &out, const LevelStats &stats) {
+  out << "\"nodes\": " << stats.nodes
+      << ", \"visited_rejections\": " << stats.visited_rejections
+      << ", \"adjacency_rejections\": " << stats.adjacency_rejections
+      << ", \"symmetry_rejections\": " << stats.symmetry_rejections
+      << ", \"dead_ends\": " << stats.dead_ends
+      << ", \"adjacency_probes\": " << stats.adjacency_probes;
+}
+}  // namespace
+
+void LevelStats::Add(const LevelStats &other) {
+  nodes += other.nodes;
+  visited_rejections += other.visited_rejections;
+  adjacency_rejections += other.adjacency_rejections;
+  symmetry_rejections += other.symmetry_rejections;
+  dead_ends += other.dead_ends;
+  adjacency_probes += other.adjacency_probes;
+}
+
+/**
+ * @param num_levels number of query vertices.
+ */
+SearchStats::SearchStats(size_t num_levels) : levels_(num_levels + 1) {}
+SearchStats::~SearchStats() {}
+
+/**
+ * @brief Adds the counters of other level by level.
+ *
+ * @param other
+ */
+void SearchStats::Add(const SearchStats &other) {
+  if (levels_.size() < other.levels_.size())
+    levels_.resize(other.levels_.size());
+  for (size_t l = 0; l < other.levels_.size(); ++l)
+    levels_[l].Add(other.levels_[l]);
+}
+
+/**
+ * @brief Writes {"levels": [{"level": 1, ...}, ...], "total": {...}}.
+ *
+ * @param out
+ */
+void SearchStats::WriteJSON(std::ostream &out) const {
+  LevelStats total;
+  out << "{\n  \"levels\": [";
+  for (size_t l = 1; l < levels_.size(); ++l) {
+    out << (l > 1 ? ",\n" : "\n") << "    {\"level\": " << l << ", ";
+    WriteLevel(out, levels_[l]);
+    out << "}";
+    total.Add(levels_[l]);
+  }
+  out << "\n  ],\n  \"total\": {";
+  WriteLevel(out, total);
+  out << "}\n}\n";
+}
@@ -0,0 +1,738 @@
+/**
+ * @file search_worker.cc
+ *
+ */
+
+#include "search_worker.h"
+#include "intersection.h"
+
+namespace {
+// search steps between two updates of the published progress
+const uint32_t kPublishInterval = 4096;
+
+// counts of leaf assignments saturate instead of wrapping around
+inline size_t SaturatingAdd(size_t a, size_t b) {
+  return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+}
+inline size_t SaturatingMultiply(size_t a, size_t b) {
+  return b != 0 && a > SIZE_MAX / b ? SIZE_MAX : a * b;
+}
+}  // namespace
+
+// counts n events at a level, except at the levels replayed from the prefix
+// of a task, which were counted by the worker that created it
+#ifdef SEARCH_STATS
+#define SEARCH_STAT(level, counter, n)                   \
+  do {                                                   \
+    if ((level) > forced_) stats_[level].counter += (n); \
+  } while (0)
+#else
+#define SEARCH_STAT(level, counter, n) \
+  do {                                 \
+  } while (0)
+#endif
+
+SearchWorker::SearchWorker(const Graph &data, const Graph &dag,
+                           const CandidateSet &cs, const CandidateSpace &space,
+                           const MatchingOrder &order,
+                           const QuerySymmetry *symmetry,
+                           SearchContext &context, size_t id)
+    : data_(data),
+      dag_(dag),
+      cs_(cs),
+      space_(space),
+      matching_order_(order),
+      symmetry_(symmetry),
+      context_(context),
+      options_(context.options),
+      pool_(context.pool),
+      id_(id),
+      num_query_vertices_(dag.GetNumVertices()),
+      num_matches_(0),
+      published_matches_(0),
+      covered_(0),
+      completed_(0),
+      unit_(num_query_vertices_ + 1, 0),
+      donated_(num_query_vertices_ + 1, 0),
+      top_end_(0),
+      publish_countdown_(kPublishInterval),
+      forced_(0),
+      embedding_(num_query_vertices_, -1),
+      position_(num_query_vertices_, 0),
+      visited_(data.GetNumVertices(), 0),
+      epoch_(0),
+      num_parents_(num_query_vertices_),
+      num_matched_parents_(num_query_vertices_, 0),
+      candidate_offset_(num_query_vertices_ + 1, 0),
+      num_candidates_(num_query_vertices_, 0),
+      order_(num_query_vertices_ + 1),
+      cursor_(num_query_vertices_ + 1),
+      end_(num_query_vertices_ + 1),
+      owner_(data.GetNumVertices(), -1),
+      failed_child_(-1),
+      fs_words_((num_query_vertices_ + 63) / 64) {
+  size_t max_candidates = 0;
+  for (size_t u = 0; u < num_query_vertices_; ++u) {
+    num_parents_[u] = dag.GetParentEndOffset(u) - dag.GetParentStartOffset(u);
+    candidate_offset_[u + 1] =
+        candidate_offset_[u] + cs.GetCandidateSize(u) + kIntersectPadding;
+    max_candidates = std::max(max_candidates, cs.GetCandidateSize(u));
+  }
+  candidates_.resize(candidate_offset_[num_query_vertices_]);
+  scratch_.resize(max_candidates + kIntersectPadding);
+
+  size_t max_leaf_candidates = 0;
+  for (size_t u = 0; u < num_query_vertices_; ++u) {
+    if (!order.IsPostponed(u)) continue;
+    leaves_.push_back(u);
+    max_leaf_candidates += cs.GetCandidateSize(u);
+  }
+  std::stable_sort(leaves_.begin(), leaves_.end(), [&dag](Vertex a, Vertex b) {
+    return dag.GetLabel(a) < dag.GetLabel(b);
+  });
+  for (size_t i = 0; i < leaves_.size(); ++i)
+    if (i == 0 || dag.GetLabel(leaves_[i]) != dag.GetLabel(leaves_[i - 1]))
+      leaf_group_offset_.push_back(i);
+  leaf_group_offset_.push_back(leaves_.size());
+  num_levels_ = num_query_vertices_ - leaves_.size();
+  leaf_offset_.resize(leaves_.size() + 1, 0);
+  leaf_candidates_.resize(max_leaf_candidates);
+
+  if (options_.failing_sets) {
+    ancestors_.resize(num_query_vertices_ * fs_words_, 0);
+    failing_sets_.resize((num_query_vertices_ + 1) * fs_words_, 0);
+    conflict_.resize(fs_words_, 0);
+    found_.resize(num_query_vertices_ + 1, 0);
+
+    // parents come first in topological order
+    for (Vertex u : dag.GetTopologicalOrder()) {
+      uint64_t *anc = &ancestors_[u * fs_words_];
+      anc[u / 64] |= 1ULL << (u % 64);
+      for (size_t i = dag.GetParentStartOffset(u);
+           i < dag.GetParentEndOffset(u); ++i) {
+        const uint64_t *parent_anc = GetAncestors(dag.GetParent(i));
+        for (size_t w = 0; w < fs_words_; ++w) anc[w] |= parent_anc[w];
+      }
+    }
+  }
+
+  if (context.sink != nullptr) output_.reset(new OutputBuffer(*context.sink));
+  if (symmetry_ != nullptr)
+    expanded_.resize((symmetry_->GetNumSteps() + 1) * num_query_vertices_);
+
+#ifdef SEARCH_STATS
+  stats_ = SearchStats(num_query_vertices_);
+#endif
+}
+
+SearchWorker::~SearchWorker() {}
+
+/**
+ * @brief Runs tasks until every task of the pool has been finished. Once the
+ * search is stopped, the remaining tasks are drained without being explored.
+ */
+void SearchWorker::Run() {
+  SearchTask task;
+  while (pool_.Pop(id_, task)) {
+    if (!context_.stop.load(std::memory_order_relaxed)) RunTask(task);
+    pool_.Done();
+  }
+  if (output_) output_->Flush();
+
+  if (options_.limit == 0) {
+    size_t total = context_.num_matches.load();
+    while (!context_.num_matches.compare_exchange_weak(
+        total, SaturatingAdd(total, num_matches_))) {
+    }
+  }
+
+#ifdef SEARCH_STATS
+  std::lock_guard<std::mutex> lock(context_.stats_mutex);
+  context_.stats.Add(stats_);
+#endif
+}
+
+/**
+ * @brief Explores the subtree described by the task. The prefix levels are
+ * replayed with a single candidate each, which reproduces the state (and the
+ * matching order) of the worker that created the task.
+ *
+ * @param task
+ */
+void SearchWorker::RunTask(const SearchTask &task) {
+  forced_ = task.prefix.size();
+
+  // a new epoch unmarks every data vertex without touching visited_
+  if (++epoch_ == 0) {
+    std::fill(visited_.begin(), visited_.end(), 0);
+    epoch_ = 1;
+  }
+  std::fill(embedding_.begin(), embedding_.end(), -1);
+  std::fill(num_matched_parents_.begin(), num_matched_parents_.end(), 0);
+
+  // visit root of DAG at level 1
+  Vertex root = dag_.GetRoot();
+  if (forced_ > 0)
+    SetCandidates(root, &task.prefix[0], &task.prefix[0] + 1);
+  else
+    SetCandidates(root, task.candidates.data(),
+                  task.candidates.data() + task.candidates.size());
+  order_[1] = root;
+  cursor_[1] = 0;
+  end_[1] = num_candidates_[root];
+  donated_[1] = 0;
+  if (forced_ == 0) {
+    unit_[1] = task.weight;
+    top_end_ = end_[1];
+  }
+
+  const bool failing_sets = options_.failing_sets;
+  if (failing_sets) ClearFailingSet(1);
+
+  // currently (level-1) vertices matched
+  size_t level = 1;
+  while (level != 0) {
+    if (context_.stop.load(std::memory_order_relaxed)) return;
+
+    // hand part of the search over to an idle worker
+    if (pool_.IsHungry() && pool_.IsEmpty(id_)) Donate(level);
+
+    if (--publish_countdown_ == 0) PublishProgress(level);
+
+    Vertex u = order_[level];
+
+    // current level search done
+    if (cursor_[level] >= end_[level]) {
+      // the parent counts its whole subtree once done, the donated part
+      // is counted by the task that runs it
+      completed_ -= unit_[level] * donated_[level];
+      level--;
+      if (level != 0) {
+        Unmatch(order_[level]);
+        if (failing_sets) {
+          if (found_[level + 1])
+            found_[level] = true;
+          else
+            AddFailingSet(level, GetFailingSet(level + 1));
+        }
+        cursor_[level]++;
+      }
+      continue;
+    }
+
+    uint32_t i = candidates_[candidate_offset_[u] + cursor_[level]];
+    Vertex v = cs_.GetCandidate(u, i);
+
+    // v already matched
+    if (IsVisited(v)) {
+      SEARCH_STAT(level, visited_rejections, 1);
+      if (failing_sets) AddConflict(level, u, owner_[v]);
+      cursor_[level]++;
+      continue;
+    }
+
+    // v violates a symmetry-breaking constraint
+    Vertex conflict;
+    if (symmetry_ != nullptr &&
+        !symmetry_->IsAllowed(u, v, embedding_.data(), &conflict)) {
+      SEARCH_STAT(level, symmetry_rejections, 1);
+      if (failing_sets) AddConflict(level, u, conflict);
+      cursor_[level]++;
+      continue;
+    }
+
+    // some child of u cannot be matched anymore
+    if (!Match(u, i, level)) {
+      SEARCH_STAT(level, dead_ends, 1);
+      if (failing_sets) AddFailingSet(level, GetAncestors(failed_child_));
+      cursor_[level]++;
+      continue;
+    }
+    SEARCH_STAT(level, nodes, 1);
+
+    // if all u matched (but the leaves), print result
+    if (level == num_levels_) {
+      if (!Emit()) return;
+      Unmatch(u);
+      if (failing_sets) found_[level] = true;
+      cursor_[level]++;
+      continue;
+    }
+
+    Vertex next = SelectNext();
+    if (next < 0) {
+      Unmatch(u);
+      if (failing_sets) found_[level] = true;
+      cursor_[level]++;
+      continue;
+    }
+
+    level++;
+    if (failing_sets) ClearFailingSet(level);
+    order_[level] = next;
+    if (level <= forced_)
+      SetCandidates(next, &task.prefix[level - 1], &task.prefix[level - 1] + 1);
+    else if (level == forced_ + 1)
+      SetCandidates(next, task.candidates.data(),
+                    task.candidates.data() + task.candidates.size());
+    cursor_[level] = 0;
+    end_[level] = num_candidates_[next];
+    donated_[level] = 0;
+    if (level == forced_ + 1) {
+      unit_[level] = task.weight;
+      top_end_ = end_[level];
+    } else if (level > forced_ + 1) {
+      unit_[level] = unit_[level - 1] / end_[level];
+    }
+  }
+
+  completed_ += task.weight * top_end_;
+  covered_.store(completed_, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Publishes the share of the search tree covered so far: the finished
+ * tasks, plus, at every level of the current task, the share of the
+ * candidates that were tried before the current one.
+ *
+ * @param level current level.
+ */
+void SearchWorker::PublishProgress(size_t level) {
+  publish_countdown_ = kPublishInterval;
+  double covered = completed_;
+  for (size_t l = forced_ + 1; l <= level; ++l)
+    covered += unit_[l] * (l == forced_ + 1 ? std::min(cursor_[l], top_end_)
+                                            : cursor_[l]);
+  covered_.store(covered, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Matches u to its i-th candidate and computes the extendable
+ * candidates of the children of u whose parents are now all matched.
+ *
+ * @param u query vertex.
+ * @param i position of the data vertex in the candidate set of u.
+ * @param level level of u.
+ * @return false if some child is left without candidates; u is unmatched
+ * again in that case.
+ */
+bool SearchWorker::Match(Vertex u, uint32_t i, size_t level) {
+  Vertex v = cs_.GetCandidate(u, i);
+  embedding_[u] = v;
+  position_[u] = i;
+  visited_[v] = epoch_;
+  owner_[v] = u;
+
+  bool extendable = true;
+  for (size_t ci = dag_.GetNeighborStartOffset(u);
+       ci < dag_.GetNeighborEndOffset(u); ++ci) {
+    Vertex cu = dag_.GetNeighbor(ci);
+    if (++num_matched_parents_[cu] == num_parents_[cu] && extendable) {
+      extendable = ComputeCandidates(cu, level);
+      if (!extendable) failed_child_ = cu;
+    }
+  }
+
+  if (!extendable) Unmatch(u);
+  return extendable;
+}
+
+/**
+ * @brief Reverts Match(u, v).
+ *
+ * @param u query vertex.
+ */
+void SearchWorker::Unmatch(Vertex u) {
+  for (size_t i = dag_.GetNeighborStartOffset(u);
+       i < dag_.GetNeighborEndOffset(u); ++i)
+    --num_matched_parents_[dag_.GetNeighbor(i)];
+
+  visited_[embedding_[u]] = 0;
+  embedding_[u] = -1;
+}
+
+/**
+ * @brief Fills the candidate buffer of u with the unvisited candidates that
+ * are adjacent to the data vertices of all parents of u, i.e. the
+ * intersection of the CandidateSpace lists of the parents. With failing
+ * sets, visited candidates are kept so that the conflict is seen (and
+ * recorded) when they are tried; otherwise an empty buffer could not be
+ * blamed on the ancestors of u alone.
+ *
+ * @param u query vertex whose parents are all matched.
+ * @param level level of the parent matched last.
+ * @return false if u has no extendable candidate.
+ */
+bool SearchWorker::ComputeCandidates(Vertex u, size_t level) {
+  uint32_t *out = &candidates_[candidate_offset_[u]];
+  size_t pb = dag_.GetParentStartOffset(u);
+  size_t pe = dag_.GetParentEndOffset(u);
+
+  // start from the shortest list so the intermediate results stay small
+  size_t first = pb;
+  for (size_t e = pb + 1; e < pe; ++e) {
+    if (space_.GetAdjacentSize(e, position_[dag_.GetParent(e)]) <
+        space_.GetAdjacentSize(first, position_[dag_.GetParent(first)]))
+      first = e;
+  }
+
+  const uint32_t *src =
+      space_.GetAdjacentBegin(first, position_[dag_.GetParent(first)]);
+  size_t n = space_.GetAdjacentSize(first, position_[dag_.GetParent(first)]);
+  size_t remaining = pe - pb - 1;
+  SEARCH_STAT(level, adjacency_probes, n);
+
+  if (remaining == 0) {
+    std::copy(src, src + n, out);
+  } else {
+    // alternate between out and scratch_ so that the last result is in out
+    uint32_t *dst = remaining % 2 == 1 ? out : scratch_.data();
+    for (size_t e = pb; e < pe && n != 0; ++e) {
+      if (e == first) continue;
+      Vertex p = dag_.GetParent(e);
+      size_t size = space_.GetAdjacentSize(e, position_[p]);
+      SEARCH_STAT(level, adjacency_probes, size);
+      n = Intersect(src, n, space_.GetAdjacentBegin(e, position_[p]), size,
+                    dst);
+      src = dst;
+      dst = dst == out ? scratch_.data() : out;
+    }
+  }
+
+  SEARCH_STAT(level, adjacency_rejections, cs_.GetCandidateSize(u) - n);
+
+  if (!options_.failing_sets) {
+    size_t m = 0;
+    for (size_t k = 0; k < n; ++k)
+      if (!IsVisited(cs_.GetCandidate(u, out[k]))) out[m++] = out[k];
+    SEARCH_STAT(level, visited_rejections, n - m);
+    n = m;
+  }
+
+  num_candidates_[u] = n;
+  return n != 0;
+}
+
+/**
+ * @brief Returns the unmatched query vertex with all parents matched that
+ * comes first in the matching order, or -1.
+ *
+ * @return Vertex
+ */
+Vertex SearchWorker::SelectNext() const {
+  Vertex next = -1;
+  OrderKey best = {0, 0, 0};
+  for (size_t u = 0; u < num_query_vertices_; ++u) {
+    if (embedding_[u] >= 0 || num_matched_parents_[u] != num_parents_[u] ||
+        matching_order_.IsPostponed(u))
+      continue;
+    OrderKey key = matching_order_.GetKey(
+        u, &candidates_[candidate_offset_[u]], num_candidates_[u]);
+    if (next < 0 || key < best) {
+      next = u;
+      best = key;
+    }
+  }
+  return next;
+}
+
+/**
+ * @brief Overwrites the candidate buffer of u with [begin, end).
+ */
+void SearchWorker::SetCandidates(Vertex u, const uint32_t *begin,
+                                 const uint32_t *end) {
+  std::copy(begin, end, &candidates_[candidate_offset_[u]]);
+  num_candidates_[u] = end - begin;
+}
+
+/**
+ * @brief Splits off the pending candidates of the shallowest level that has
+ * any, as a new task that other workers can steal. The shallowest level
+ * holds the largest unexplored subtrees.
+ *
+ * @param level current level.
+ */
+void SearchWorker::Donate(size_t level) {
+  for (size_t l = forced_ + 1; l <= level; ++l) {
+    // candidates after the one in progress at level l
+    size_t first = cursor_[l] + 1;
+    if (first >= end_[l]) continue;
+
+    size_t mid = first + (end_[l] - first) / 2;
+    const uint32_t *candidates = &candidates_[candidate_offset_[order_[l]]];
+
+    SearchTask task;
+    for (size_t k = 1; k < l; ++k) task.prefix.push_back(position_[order_[k]]);
+    task.candidates.assign(candidates + mid, candidates + end_[l]);
+    task.weight = unit_[l];
+
+    // the donated candidates are covered by the task that runs them
+    if (l == forced_ + 1)
+      top_end_ = mid;
+    else
+      donated_[l] += end_[l] - mid;
+    end_[l] = mid;
+
+    pool_.Push(id_, std::move(task));
+    return;
+  }
+}
+
+/**
+ * @brief Empties the failing set of the level before its first candidate.
+ *
+ * @param level
+ */
+void SearchWorker::ClearFailingSet(size_t level) {
+  std::fill(GetFailingSet(level), GetFailingSet(level) + fs_words_, 0);
+  found_[level] = false;
+}
+
+/**
+ * @brief Merges the failing set of a child of the level. If the query vertex
+ * of the level is not in it, changing the data vertex of that query vertex
+ * cannot avoid the failure, so the level takes that failing set and its
+ * remaining candidates are skipped.
+ *
+ * @param level
+ * @param fs failing set of the child.
+ */
+void SearchWorker::AddFailingSet(size_t level, const uint64_t *fs) {
+  if (found_[level]) return;
+
+  Vertex u = order_[level];
+  uint64_t *acc = GetFailingSet(level);
+
+  if (!(fs[u / 64] >> (u % 64) & 1)) {
+    std::copy(fs, fs + fs_words_, acc);
+    end_[level] = cursor_[level] + 1;
+    return;
+  }
+
+  for (size_t w = 0; w < fs_words_; ++w) acc[w] |= fs[w];
+}
+
+/**
+ * @brief Records that u1 cannot be matched to the data vertex of u2: the
+ * failing set is the union of their ancestors.
+ *
+ * @param level
+ * @param u1 query vertex of the level.
+ * @param u2 query vertex that holds the data vertex.
+ */
+void SearchWorker::AddConflict(size_t level, Vertex u1, Vertex u2) {
+  const uint64_t *anc1 = GetAncestors(u1);
+  const uint64_t *anc2 = GetAncestors(u2);
+  for (size_t w = 0; w < fs_words_; ++w) conflict_[w] = anc1[w] | anc2[w];
+  AddFailingSet(level, conflict_.data());
+}
+
+/**
+ * @brief Reports the current embedding, and the embeddings equal to it up to
+ * a query automorphism or to an assignment of the leaves: appends them to
+ * the output buffer (as factorized records if possible), counts them, or
+ * passes them to the callback.
+ *
+ * @return false if the search must stop without these embeddings.
+ */
+bool SearchWorker::Emit() {
+  size_t count = symmetry_ != nullptr ? symmetry_->GetGroupSize() : 1;
+  // no assignment of the leaves is injective; reported like an embedding,
+  // which only keeps failing sets from pruning the siblings
+  if (!leaves_.empty() &&
+      (count = SaturatingMultiply(count, CountLeafAssignments())) == 0)
+    return true;
+
+  size_t remaining = count;
+  if (options_.limit != 0) {
+    size_t n = context_.num_matches.fetch_add(std::min(count, options_.limit));
+    if (n >= options_.limit) {
+      context_.stop = true;
+      return false;
+    }
+    if (count >= options_.limit - n) {
+      context_.stop = true;
+      remaining = options_.limit - n;
+    }
+  } else {
+    num_matches_ = SaturatingAdd(num_matches_, count);
+    published_matches_.store(num_matches_, std::memory_order_relaxed);
+  }
+
+  if (context_.mode == MatchMode::kCount) return true;
+
+  if (leaves_.empty() && symmetry_ == nullptr) {
+    Report(embedding_.data());
+    return true;
+  }
+
+  if (!leaves_.empty() && remaining == count && output_ &&
+      context_.sink->GetFormat() == OutputFormat::kFactorized) {
+    if (data_.IsReordered())
+      for (size_t k = 0; k < leaf_offset_[leaves_.size()]; ++k)
+        leaf_candidates_[k] = data_.GetOriginalID(leaf_candidates_[k]);
+    auto append = [this](const Vertex *embedding) {
+      output_->AppendFactorized(ToOriginalIDs(embedding), leaves_,
+                                leaf_candidates_.data(), leaf_offset_.data());
+      return true;
+    };
+    if (symmetry_ == nullptr)
+      append(embedding_.data());
+    else
+      symmetry_->Expand(embedding_.data(), expanded_.data(), append);
+    return true;
+  }
+
+  ExpandLeaves(0, remaining);
+  return true;
+}
+
+/**
+ * @brief Reports the current embedding and its symmetric variants, at most
+ * remaining of them.
+ *
+ * @param remaining decremented per embedding reported.
+ * @return false if the embeddings to report ran out or the callback asked to
+ * stop.
+ */
+bool SearchWorker::ReportAll(size_t &remaining) {
+  auto report = [this, &remaining](const Vertex *embedding) {
+    if (remaining == 0) return false;
+    --remaining;
+    return Report(embedding);
+  };
+  if (symmetry_ == nullptr) return report(embedding_.data());
+  return symmetry_->Expand(embedding_.data(), expanded_.data(), report);
+}
+
+/**
+ * @brief Reports every injective assignment of leaves_[i], leaves_[i + 1],
+ * ... to their collected candidates.
+ *
+ * @param i
+ * @param remaining decremented per embedding reported.
+ * @return false if the enumeration must stop.
+ */
+bool SearchWorker::ExpandLeaves(size_t i, size_t &remaining) {
+  if (i == leaves_.size()) return ReportAll(remaining);
+
+  Vertex u = leaves_[i];
+  for (size_t k = leaf_offset_[i]; k < leaf_offset_[i + 1]; ++k) {
+    Vertex v = leaf_candidates_[k];
+    if (IsVisited(v)) continue;
+    visited_[v] = epoch_;
+    embedding_[u] = v;
+    bool more = ExpandLeaves(i + 1, remaining);
+    visited_[v] = 0;
+    embedding_[u] = -1;
+    if (!more) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Collects the unvisited candidates of every leaf, and returns the
+ * number of injective assignments of the leaves to them. Within a label,
+ * leaves with the same candidates (typically siblings) take m (m - 1) ...
+ * (m - k + 1) assignments; otherwise they are counted by backtracking.
+ *
+ * @return size_t
+ */
+size_t SearchWorker::CountLeafAssignments() {
+  size_t n = 0;
+  for (size_t i = 0; i < leaves_.size(); ++i) {
+    Vertex u = leaves_[i];
+    const uint32_t *positions = &candidates_[candidate_offset_[u]];
+    for (size_t k = 0; k < num_candidates_[u]; ++k) {
+      Vertex v = cs_.GetCandidate(u, positions[k]);
+      if (!IsVisited(v)) leaf_candidates_[n++] = v;
+    }
+    leaf_offset_[i + 1] = n;
+  }
+
+  size_t total = 1;
+  for (size_t g = 0; g + 1 < leaf_group_offset_.size() && total != 0; ++g) {
+    size_t begin = leaf_group_offset_[g];
+    size_t end = leaf_group_offset_[g + 1];
+    const Vertex *first = &leaf_candidates_[leaf_offset_[begin]];
+    size_t m = leaf_offset_[begin + 1] - leaf_offset_[begin];
+
+    bool same = true;
+    for (size_t i = begin + 1; i < end && same; ++i)
+      same = leaf_offset_[i + 1] - leaf_offset_[i] == m &&
+             std::equal(first, first + m, &leaf_candidates_[leaf_offset_[i]]);
+
+    size_t count = 1;
+    if (same) {
+      for (size_t i = 0; i < end - begin; ++i)
+        count = SaturatingMultiply(count, m > i ? m - i : 0);
+    } else {
+      count = CountInjective(begin, end);
+    }
+    total = SaturatingMultiply(total, count);
+  }
+  return total;
+}
+
+/**
+ * @brief Counts the injective assignments of leaves_[i] .. leaves_[end - 1]
+ * to their collected candidates that avoid the visited data vertices.
+ *
+ * @param i
+ * @param end
+ * @return size_t
+ */
+size_t SearchWorker::CountInjective(size_t i, size_t end) {
+  size_t count = 0;
+  for (size_t k = leaf_offset_[i]; k < leaf_offset_[i + 1]; ++k) {
+    Vertex v = leaf_candidates_[k];
+    if (IsVisited(v)) continue;
+    if (i + 1 == end) {
+      ++count;
+      continue;
+    }
+    visited_[v] = epoch_;
+    count = SaturatingAdd(count, CountInjective(i + 1, end));
+    visited_[v] = 0;
+  }
+  return count;
+}
+
+/**
+ * @brief Appends the embedding to the output buffer or passes it to the
+ * callback, in the vertex ids of the input file.
+ *
+ * @param embedding
+ * @return false if the callback asked to stop.
+ */
+bool SearchWorker::Report(const Vertex *embedding) {
+  embedding = ToOriginalIDs(embedding);
+  if (context_.mode == MatchMode::kCallback) {
+    if (embedding != embedding_.data() && embedding != match_.data())
+      match_.assign(embedding, embedding + num_query_vertices_);
+    std::lock_guard<std::mutex> lock(context_.callback_mutex);
+    if ((*context_.callback)(embedding != embedding_.data() ? match_
+                                                           : embedding_))
+      return true;
+    context_.stop = true;
+    return false;
+  }
+
+  output_->Append(embedding);
+  return true;
+}
+
+/**
+ * @brief Translates an embedding to the vertex ids of the input file if the
+ * data graph was reordered. Unmatched vertices stay -1.
+ *
+ * @param embedding
+ * @return embedding itself, or match_ holding the translated embedding.
+ */
+const Vertex *SearchWorker::ToOriginalIDs(const Vertex *embedding) {
+  if (!data_.IsReordered()) return embedding;
+  match_.resize(num_query_vertices_);
+  for (size_t u = 0; u < num_query_vertices_; ++u)
+    match_[u] = embedding[u] < 0 ? -1 : data_.GetOriginalID(embedding[u]);
+  return match_.data();
+}
@@ -0,0 +1,275 @@
+/**
+ * @file server.cc
+ *
+ */
+
+#include "server.h"
+#include "backtrack.h"
+#include "candidate_set.h"
+
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+std::vector<std::string> Tokenize(const std::string &line) {
+  std::istringstream stream(line);
+  std::vector<std::string> tokens;
+  std::string token;
+  while (stream >> token) tokens.push_back(token);
+  return tokens;
+}
+}  // namespace
+
+/**
+ * @param options defaults of every match request.
+ * @param ordering vertex ordering of the data graphs.
+ */
+Server::Server(const SearchOptions &options, VertexOrdering ordering)
+    : options_(options), ordering_(ordering) {}
+Server::~Server() {}
+
+/**
+ * @brief Makes a data graph resident, unless it already is.
+ *
+ * @param filename text data graph file or snapshot.
+ * @param error set to the reason of a failure.
+ * @return bool true on success.
+ */
+bool Server::Load(const std::string &filename, std::string &error) {
+  return GetGraph(filename, error) != nullptr;
+}
+
+/**
+ * @brief Returns the resident data graph loaded from filename, loading it
+ * first if needed. The graph is loaded without holding graphs_mutex_, so
+ * that other requests go on meanwhile; if two requests load the same file,
+ * the first loaded copy is kept.
+ *
+ * @param filename text data graph file or snapshot.
+ * @param error set to the reason of a failure.
+ * @return std::shared_ptr<const Graph> nullptr on failure.
+ */
+std::shared_ptr<const Graph> Server::GetGraph(const std::string &filename,
+                                              std::string &error) {
+  {
+    std::lock_guard<std::mutex> lock(graphs_mutex_);
+    auto it = graphs_.find(filename);
+    if (it != graphs_.end()) return it->second;
+  }
+
+  std::shared_ptr<Graph> graph;
+  try {
+    graph = std::make_shared<Graph>(filename);
+    graph->Reorder(ordering_);
+  } catch (const std::exception &e) {
+    error = e.what();
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(graphs_mutex_);
+  return graphs_.emplace(filename, graph).first->second;
+}
+
+/**
+ * @brief Answers the requests read from in until "quit" or the end of the
+ * input. Responses are flushed after every request.
+ *
+ * @param in
+ * @param out
+ */
+void Server::Serve(FILE *in, FILE *out) {
+  char *line = nullptr;
+  size_t capacity = 0;
+
+  while (getline(&line, &capacity, in) != -1) {
+    std::vector<std::string> args = Tokenize(line);
+    if (args.empty()) continue;
+
+    bool more = HandleRequest(args, out);
+    fflush(out);
+    if (!more) break;
+  }
+
+  free(line);
+}
+
+/**
+ * @brief Accepts connections on a Unix socket and serves each of them on
+ * its own thread. Returns only if the socket cannot be set up.
+ *
+ * @param socket_path path of the socket; an existing file there is replaced.
+ */
+void Server::Listen(const std::string &socket_path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path " << socket_path << " is too long!\n";
+    return;
+  }
+  std::strcpy(address.sun_path, socket_path.c_str());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.c_str());
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listener, SOMAXCONN) < 0) {
+    std::cerr << "Cannot listen on " << socket_path << "!\n";
+    if (listener >= 0) close(listener);
+    return;
+  }
+
+  // a client that disconnects early must not terminate the server
+  signal(SIGPIPE, SIG_IGN);
+
+  while (true) {
+    int connection = accept(listener, nullptr, nullptr);
+    if (connection < 0) continue;
+
+    std::thread([this, connection]() {
+      FILE *in = fdopen(connection, "r");
+      FILE *out = fdopen(dup(connection), "w");
+      if (in != nullptr && out != nullptr) Serve(in, out);
+      if (out != nullptr) fclose(out);
+      if (in != nullptr) fclose(in);
+    }).detach();
+  }
+}
+
+/**
+ * @brief Runs one request.
+ *
+ * @param args the request split at blanks.
+ * @param out
+ * @return bool false if the request was "quit".
+ */
+bool Server::HandleRequest(const std::vector<std::string> &args, FILE *out) {
+  const std::string &command = args[0];
+  std::string error;
+
+  if (command == "quit") {
+    fprintf(out, "ok\n");
+    return false;
+  } else if (command == "load" && args.size() == 2) {
+    if (Load(args[1], error))
+      fprintf(out, "ok\n");
+    else
+      fprintf(out, "error %s\n", error.c_str());
+  } else if (command == "unload" && args.size() == 2) {
+    std::lock_guard<std::mutex> lock(graphs_mutex_);
+    if (graphs_.erase(args[1]))
+      fprintf(out, "ok\n");
+    else
+      fprintf(out, "error %s is not loaded\n", args[1].c_str());
+  } else if (command == "match" && args.size() >= 3) {
+    Match(args, out);
+  } else {
+    fprintf(out, "error invalid request\n");
+  }
+  return true;
+}
+
+/**
+ * @brief Runs a match request and streams its embeddings to out.
+ *
+ * @param args "match" <data> <query> [<cs>] [options...]
+ * @param out
+ */
+void Server::Match(const std::vector<std::string> &args, FILE *out) {
+  SearchOptions options = options_;
+  bool count_only = false;
+  bool refine = false;
+  size_t num_samples = 0;
+  std::vector<std::string> files;
+
+  try {
+    for (size_t i = 1; i < args.size(); ++i) {
+      const std::string &arg = args[i];
+      if (arg == "--limit" && i + 1 < args.size()) {
+        options.limit = std::stoul(args[++i]);
+      } else if (arg == "--threads" && i + 1 < args.size()) {
+        options.num_threads = std::stoul(args[++i]);
+      } else if (arg == "--time-limit" && i + 1 < args.size()) {
+        options.time_limit = std::stod(args[++i]);
+      } else if (arg == "--count") {
+        count_only = true;
+      } else if (arg == "--failing-sets") {
+        options.failing_sets = true;
+      } else if (arg == "--symmetry") {
+        options.symmetry_breaking = true;
+      } else if (arg == "--no-symmetry") {
+        options.symmetry_breaking = false;
+      } else if (arg == "--factorize") {
+        options.factorize = true;
+      } else if (arg == "--refine") {
+        refine = true;
+      } else if (arg == "--estimate" && i + 1 < args.size()) {
+        num_samples = std::stoul(args[++i]);
+      } else if (arg == "--order" && i + 1 < args.size()) {
+        if (!ParseOrderStrategy(args[++i], options.order))
+          throw std::invalid_argument(args[i]);
+      } else if (arg == "--dag-frontier" && i + 1 < args.size()) {
+        if (!ParseDAGFrontier(args[++i], options.dag_frontier))
+          throw std::invalid_argument(args[i]);
+      } else if (arg.compare(0, 2, "--") == 0) {
+        throw std::invalid_argument(arg);
+      } else {
+        files.push_back(arg);
+      }
+    }
+  } catch (const std::exception &) {
+    fprintf(out, "error invalid request\n");
+    return;
+  }
+
+  if (files.size() < 2 || files.size() > 3) {
+    fprintf(out, "error invalid request\n");
+    return;
+  }
+
+  std::string error;
+  std::shared_ptr<const Graph> data = GetGraph(files[0], error);
+  if (data == nullptr) {
+    fprintf(out, "error %s\n", error.c_str());
+    return;
+  }
+  try {
+    Graph query(files[1], *data);
+    CandidateSet candidate_set = files.size() < 3
+                                     ? CandidateSet(*data, query)
+                                     : CandidateSet(files[2], *data);
+    if (files.size() == 3) candidate_set.CheckFits(*data, query);
+    if (refine)
+      candidate_set.MakeArcConsistent(*data, query, options.num_threads);
+
+    // responses are line-based, so embeddings are always sent as text
+    options.output_format = OutputFormat::kText;
+    Backtrack backtrack(options);
+
+    if (num_samples != 0) {
+      CountEstimate estimate = backtrack.EstimateMatches(
+          *data, query, candidate_set, num_samples);
+      fprintf(out, "ok %.6g %.6g %.6g%s\n", estimate.estimate, estimate.low,
+              estimate.high, estimate.reliable ? "" : " unreliable");
+      return;
+    }
+
+    size_t num_matches =
+        count_only
+            ? backtrack.CountMatches(*data, query, candidate_set)
+            : backtrack.PrintAllMatches(*data, query, candidate_set, out);
+    fprintf(out, "ok %zu%s\n", num_matches,
+            backtrack.IsInterrupted() ? " interrupted" : "");
+  } catch (const std::exception &e) {
+    fprintf(out, "error %s\n", e.what());
+  }
+}
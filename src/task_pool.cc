@@ -0,0 +1,97 @@
+/**
+ * @file task_pool.cc
+ *
+ */
+
+#include "task_pool.h"
+
+#include <chrono>
+
+TaskPool::TaskPool(size_t num_workers) : pending_(0), hungry_(0) {
+  for (size_t i = 0; i < num_workers; ++i) {
+    deques_.emplace_back(new Deque());
+    deques_.back()->size = 0;
+  }
+}
+
+TaskPool::~TaskPool() {}
+
+/**
+ * @brief Queues a task on the deque of the given worker.
+ *
+ * @param worker worker index.
+ * @param task
+ */
+void TaskPool::Push(size_t worker, SearchTask &&task) {
+  pending_.fetch_add(1);
+  {
+    Deque &deque = *deques_[worker];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    deque.tasks.push_back(std::move(task));
+    deque.size.fetch_add(1, std::memory_order_relaxed);
+  }
+  wait_cv_.notify_one();
+}
+
+/**
+ * @brief Takes the newest task of the worker's own deque, or steals the
+ * oldest task of another worker. Blocks while other workers are still running
+ * tasks that may be split.
+ *
+ * @param worker worker index.
+ * @param task receives the task.
+ * @return false if every task has been finished.
+ */
+bool TaskPool::Pop(size_t worker, SearchTask &task) {
+  bool hungry = false;
+
+  while (true) {
+    if (TryPop(worker, task)) {
+      if (hungry) hungry_.fetch_sub(1);
+      return true;
+    }
+    if (pending_.load() == 0) {
+      if (hungry) hungry_.fetch_sub(1);
+      return false;
+    }
+    if (!hungry) {
+      hungry = true;
+      hungry_.fetch_add(1);
+    }
+
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    wait_cv_.wait_for(lock, std::chrono::milliseconds(1));
+  }
+}
+
+/**
+ * @brief Marks a task returned by Pop as finished.
+ */
+void TaskPool::Done() {
+  if (pending_.fetch_sub(1) == 1) wait_cv_.notify_all();
+}
+
+bool TaskPool::TryPop(size_t worker, SearchTask &task) {
+  size_t n = deques_.size();
+
+  for (size_t i = 0; i < n; ++i) {
+    Deque &deque = *deques_[(worker + i) % n];
+    if (deque.size.load(std::memory_order_relaxed) == 0) continue;
+
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if (deque.tasks.empty()) continue;
+
+    // own tasks are taken LIFO, stolen tasks FIFO (the largest subtrees)
+    if (i == 0) {
+      task = std::move(deque.tasks.back());
+      deque.tasks.pop_back();
+    } else {
+      task = std::move(deque.tasks.front());
+      deque.tasks.pop_front();
+    }
+    deque.size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  return false;
+}
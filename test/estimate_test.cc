@@ -0,0 +1,61 @@
+/**
+ * @file estimate_test.cc
+ * @brief checks that the confidence intervals of Backtrack::EstimateMatches
+ * do not exclude the known numbers of embeddings of bundled queries.
+ *
+ */
+
+#include "backtrack.h"
+#include "candidate_set.h"
+#include "common.h"
+#include "graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+const size_t kNumSamples = 100000;
+
+struct Case {
+  const char *data;
+  const char *query;
+  // number of embeddings, or a lower bound of it
+  double count;
+  bool exact;
+};
+
+// lcc_yeast_s3 is too large to count; a search finds 100000 embeddings
+// within milliseconds, so the interval must reach at least that
+const Case kCases[] = {
+    {"lcc_hprd", "lcc_hprd_n1", 96, true},
+    {"lcc_hprd", "lcc_hprd_n3", 908544, true},
+    {"lcc_yeast", "lcc_yeast_s3", 100000, false},
+};
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::string root = argc > 1 ? argv[1] : ".";
+  size_t num_failures = 0;
+
+  for (const Case &c : kCases) {
+    Graph data(root + "/data/" + c.data + ".igraph");
+    Graph query(root + "/query/" + c.query + ".igraph", data);
+    CandidateSet cs(root + "/candidate_set/" + c.query + ".cs", data);
+
+    Backtrack backtrack;
+    CountEstimate estimate =
+        backtrack.EstimateMatches(data, query, cs, kNumSamples);
+
+    // an exact count must be inside the interval, a lower bound below its
+    // upper end
+    bool ok = estimate.low <= estimate.estimate &&
+              estimate.estimate <= estimate.high && c.count <= estimate.high &&
+              (!c.exact || (estimate.low <= c.count && estimate.reliable));
+    num_failures += !ok;
+    printf("%-14s %s %.6g: %.6g [%.6g, %.6g]%s\n", c.query,
+           c.exact ? "count" : "at least", c.count, estimate.estimate,
+           estimate.low, estimate.high,
+           ok ? "" : (estimate.reliable ? "  FAIL" : "  FAIL (unreliable)"));
+  }
+  return num_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}